@@ -48,6 +48,10 @@ struct _MetaCursorTracker {
 
   /* The cursor from the X11 server. */
   MetaCursorSprite *xfixes_cursor;
+  /* XFixes serial of the current X11 cursor, 0 if not known yet */
+  unsigned long xfixes_cursor_serial;
+  /* Recently seen X11 cursors (XFixesCachedCursor), most recent first */
+  GQueue xfixes_cursor_cache;
 };
 
 struct _MetaCursorTrackerClass {
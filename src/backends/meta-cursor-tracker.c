@@ -43,9 +43,27 @@
 #include <X11/extensions/Xfixes.h>
 
 #include "meta-backend-private.h"
+#include "x11/roundtrip-audit.h"
 
 G_DEFINE_TYPE (MetaCursorTracker, meta_cursor_tracker, G_TYPE_OBJECT);
 
+/* Number of X11 cursor images kept, so that switching back to a recently
+ * used cursor needs neither a round trip nor a texture upload */
+#define XFIXES_CURSOR_CACHE_SIZE 16
+
+typedef struct
+{
+  unsigned long serial;
+  MetaCursorSprite *sprite;
+} XFixesCachedCursor;
+
+static void
+xfixes_cached_cursor_free (XFixesCachedCursor *cached)
+{
+  g_object_unref (cached->sprite);
+  g_slice_free (XFixesCachedCursor, cached);
+}
+
 enum {
   CURSOR_CHANGED,
   LAST_SIGNAL
@@ -110,6 +128,10 @@ meta_cursor_tracker_finalize (GObject *object)
     g_object_unref (self->displayed_cursor);
   if (self->root_cursor)
     g_object_unref (self->root_cursor);
+  g_clear_object (&self->xfixes_cursor);
+  g_queue_foreach (&self->xfixes_cursor_cache,
+                   (GFunc) xfixes_cached_cursor_free, NULL);
+  g_queue_clear (&self->xfixes_cursor_cache);
 
   G_OBJECT_CLASS (meta_cursor_tracker_parent_class)->finalize (object);
 }
@@ -184,11 +206,28 @@ meta_cursor_tracker_handle_xevent (MetaCursorTracker *tracker,
     return FALSE;
 
   g_clear_object (&tracker->xfixes_cursor);
+  tracker->xfixes_cursor_serial = notify_event->cursor_serial;
   g_signal_emit (tracker, signals[CURSOR_CHANGED], 0);
 
   return TRUE;
 }
 
+static void
+cache_xfixes_cursor (MetaCursorTracker *tracker,
+                     unsigned long      serial,
+                     MetaCursorSprite  *cursor_sprite)
+{
+  XFixesCachedCursor *cached;
+
+  cached = g_slice_new (XFixesCachedCursor);
+  cached->serial = serial;
+  cached->sprite = g_object_ref (cursor_sprite);
+  g_queue_push_head (&tracker->xfixes_cursor_cache, cached);
+
+  while (tracker->xfixes_cursor_cache.length > XFIXES_CURSOR_CACHE_SIZE)
+    xfixes_cached_cursor_free (g_queue_pop_tail (&tracker->xfixes_cursor_cache));
+}
+
 static void
 ensure_xfixes_cursor (MetaCursorTracker *tracker)
 {
@@ -202,7 +241,26 @@ ensure_xfixes_cursor (MetaCursorTracker *tracker)
   if (tracker->xfixes_cursor)
     return;
 
-  cursor_image = XFixesGetCursorImage (display->xdisplay);
+  if (tracker->xfixes_cursor_serial != 0)
+    {
+      GList *l;
+
+      for (l = tracker->xfixes_cursor_cache.head; l; l = l->next)
+        {
+          XFixesCachedCursor *cached = l->data;
+
+          if (cached->serial == tracker->xfixes_cursor_serial)
+            {
+              g_queue_unlink (&tracker->xfixes_cursor_cache, l);
+              g_queue_push_head_link (&tracker->xfixes_cursor_cache, l);
+              tracker->xfixes_cursor = g_object_ref (cached->sprite);
+              return;
+            }
+        }
+    }
+
+  META_X_ROUNDTRIP ("XFixesGetCursorImage",
+                    cursor_image = XFixesGetCursorImage (display->xdisplay));
   if (!cursor_image)
     return;
 
@@ -253,6 +311,11 @@ ensure_xfixes_cursor (MetaCursorTracker *tracker)
                                       cursor_image->yhot);
       cogl_object_unref (sprite);
       tracker->xfixes_cursor = cursor_sprite;
+
+      /* The image carries the serial of the cursor it was taken from,
+       * which may be newer than the last notify we processed */
+      tracker->xfixes_cursor_serial = cursor_image->cursor_serial;
+      cache_xfixes_cursor (tracker, cursor_image->cursor_serial, cursor_sprite);
     }
   XFree (cursor_image);
 }
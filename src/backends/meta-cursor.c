@@ -43,6 +43,38 @@ enum {
 
 static guint signals[LAST_SIGNAL];
 
+/* All theme cursors at one theme, size and scale, packed into a single
+ * texture. Atlases are built on a worker thread, so that changing or
+ * animating a theme cursor only has to pick another sub-texture instead
+ * of loading images from disk and uploading them. */
+typedef struct _MetaCursorAtlas
+{
+  int ref_count;
+
+  char *theme;
+  int size;
+  int scale;
+
+  XcursorImages *images[META_CURSOR_LAST];
+  /* Position of each frame of each cursor in the atlas */
+  int *frame_x[META_CURSOR_LAST];
+  int *frame_y[META_CURSOR_LAST];
+
+  /* Packed pixels, only until they are uploaded */
+  guint8 *pixels;
+  int width;
+  int height;
+
+  CoglTexture2D *texture;
+  CoglTexture **frame_textures[META_CURSOR_LAST];
+} MetaCursorAtlas;
+
+#define CURSOR_ATLAS_WIDTH      1024
+#define CURSOR_ATLAS_MAX_HEIGHT 4096
+
+/* "theme:size:scale" -> MetaCursorAtlas, for the current theme only */
+static GHashTable *cursor_atlases;
+
 struct _MetaCursorSprite
 {
   GObject parent;
@@ -55,6 +87,9 @@ struct _MetaCursorSprite
 
   int current_frame;
   XcursorImages *xcursor_images;
+  /* If set, xcursor_images belongs to the atlas and the frames are
+   * sub-textures of it */
+  MetaCursorAtlas *atlas;
 
   int theme_scale;
   gboolean theme_dirty;
@@ -125,6 +160,324 @@ load_cursor_on_client (MetaCursor cursor, int scale)
                                    meta_prefs_get_cursor_size () * scale);
 }
 
+static void
+meta_cursor_atlas_unref (MetaCursorAtlas *atlas)
+{
+  int i, j;
+
+  if (--atlas->ref_count > 0)
+    return;
+
+  for (i = 0; i < META_CURSOR_LAST; i++)
+    {
+      if (atlas->frame_textures[i])
+        {
+          for (j = 0; j < atlas->images[i]->nimage; j++)
+            cogl_object_unref (atlas->frame_textures[i][j]);
+          g_free (atlas->frame_textures[i]);
+        }
+
+      if (atlas->images[i])
+        XcursorImagesDestroy (atlas->images[i]);
+
+      g_free (atlas->frame_x[i]);
+      g_free (atlas->frame_y[i]);
+    }
+
+  if (atlas->texture)
+    cogl_object_unref (atlas->texture);
+  g_free (atlas->pixels);
+  g_free (atlas->theme);
+  g_slice_free (MetaCursorAtlas, atlas);
+}
+
+static char *
+cursor_atlas_key (const char *theme,
+                  int         size,
+                  int         scale)
+{
+  return g_strdup_printf ("%s:%d:%d", theme ? theme : "", size, scale);
+}
+
+static void
+ensure_cursor_atlases (void)
+{
+  if (cursor_atlases == NULL)
+    cursor_atlases = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                            (GDestroyNotify) meta_cursor_atlas_unref);
+}
+
+static void start_cursor_atlas (const char *theme,
+                                int         size,
+                                int         scale);
+
+static MetaCursorAtlas *
+lookup_cursor_atlas (MetaCursor cursor,
+                     int        scale)
+{
+  MetaCursorAtlas *atlas;
+  char *key;
+
+  /* Atlases are only used once meta_cursor_sprite_preload_theme() has
+   * been called, which is also what drops those of an old theme. */
+  if (cursor_atlases == NULL)
+    return NULL;
+
+  key = cursor_atlas_key (meta_prefs_get_cursor_theme (),
+                          meta_prefs_get_cursor_size (),
+                          scale);
+  atlas = g_hash_table_lookup (cursor_atlases, key);
+  g_free (key);
+
+  /* A scale that wasn't preloaded, e.g. after a monitor was added */
+  if (atlas == NULL)
+    {
+      start_cursor_atlas (meta_prefs_get_cursor_theme (),
+                          meta_prefs_get_cursor_size (),
+                          scale);
+      return NULL;
+    }
+
+  /* Still being built, or the cursor didn't fit */
+  if (atlas->texture == NULL || atlas->frame_textures[cursor] == NULL)
+    return NULL;
+
+  atlas->ref_count++;
+  return atlas;
+}
+
+/* Runs in a worker thread: loads every theme cursor and packs all their
+ * frames into atlas->pixels, row by row. */
+static void
+build_cursor_atlas_thread (GTask        *task,
+                           gpointer      source_object,
+                           gpointer      task_data,
+                           GCancellable *cancellable)
+{
+  MetaCursorAtlas *atlas = task_data;
+  int x = 0, y = 0, row_height = 0;
+  int cursor, i, row;
+
+  for (cursor = META_CURSOR_DEFAULT; cursor < META_CURSOR_LAST; cursor++)
+    {
+      XcursorImages *images;
+      int start_x = x, start_y = y, start_row_height = row_height;
+      gboolean fits = TRUE;
+
+      images = XcursorLibraryLoadImages (translate_meta_cursor (cursor),
+                                         atlas->theme,
+                                         atlas->size * atlas->scale);
+      if (images == NULL)
+        continue;
+
+      atlas->frame_x[cursor] = g_new (int, images->nimage);
+      atlas->frame_y[cursor] = g_new (int, images->nimage);
+
+      for (i = 0; i < images->nimage; i++)
+        {
+          XcursorImage *image = images->images[i];
+
+          if ((int) image->width > CURSOR_ATLAS_WIDTH)
+            {
+              fits = FALSE;
+              break;
+            }
+
+          if (x + (int) image->width > CURSOR_ATLAS_WIDTH)
+            {
+              x = 0;
+              y += row_height;
+              row_height = 0;
+            }
+
+          if (y + (int) image->height > CURSOR_ATLAS_MAX_HEIGHT)
+            {
+              fits = FALSE;
+              break;
+            }
+
+          atlas->frame_x[cursor][i] = x;
+          atlas->frame_y[cursor][i] = y;
+
+          x += image->width;
+          row_height = MAX (row_height, (int) image->height);
+        }
+
+      if (!fits)
+        {
+          /* Leave it to be loaded on its own when needed */
+          g_clear_pointer (&atlas->frame_x[cursor], g_free);
+          g_clear_pointer (&atlas->frame_y[cursor], g_free);
+          XcursorImagesDestroy (images);
+          x = start_x;
+          y = start_y;
+          row_height = start_row_height;
+          continue;
+        }
+
+      atlas->images[cursor] = images;
+    }
+
+  atlas->width = CURSOR_ATLAS_WIDTH;
+  atlas->height = y + row_height;
+
+  if (atlas->height > 0)
+    {
+      atlas->pixels = g_malloc0 ((gsize) atlas->width * atlas->height * 4);
+
+      for (cursor = META_CURSOR_DEFAULT; cursor < META_CURSOR_LAST; cursor++)
+        {
+          if (atlas->images[cursor] == NULL)
+            continue;
+
+          for (i = 0; i < atlas->images[cursor]->nimage; i++)
+            {
+              XcursorImage *image = atlas->images[cursor]->images[i];
+
+              for (row = 0; row < (int) image->height; row++)
+                memcpy (atlas->pixels +
+                        ((gsize) (atlas->frame_y[cursor][i] + row) * atlas->width +
+                         atlas->frame_x[cursor][i]) * 4,
+                        image->pixels + row * image->width,
+                        image->width * 4);
+            }
+        }
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+on_cursor_atlas_built (GObject      *source_object,
+                       GAsyncResult *result,
+                       gpointer      user_data)
+{
+  MetaCursorAtlas *atlas = g_task_get_task_data (G_TASK (result));
+  CoglPixelFormat cogl_format;
+  CoglContext *cogl_context;
+  int cursor, i;
+
+  if (atlas->pixels == NULL)
+    goto out;
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+  cogl_format = COGL_PIXEL_FORMAT_BGRA_8888;
+#else
+  cogl_format = COGL_PIXEL_FORMAT_ARGB_8888;
+#endif
+
+  cogl_context = clutter_backend_get_cogl_context (clutter_get_default_backend ());
+  atlas->texture = cogl_texture_2d_new_from_data (cogl_context,
+                                                  atlas->width, atlas->height,
+                                                  cogl_format,
+                                                  atlas->width * 4,
+                                                  atlas->pixels,
+                                                  NULL);
+  g_clear_pointer (&atlas->pixels, g_free);
+
+  if (atlas->texture == NULL)
+    {
+      meta_warning ("Failed to upload the cursor atlas\n");
+      goto out;
+    }
+
+  for (cursor = META_CURSOR_DEFAULT; cursor < META_CURSOR_LAST; cursor++)
+    {
+      XcursorImages *images = atlas->images[cursor];
+
+      if (images == NULL)
+        continue;
+
+      atlas->frame_textures[cursor] = g_new (CoglTexture *, images->nimage);
+      for (i = 0; i < images->nimage; i++)
+        {
+          CoglSubTexture *sub_texture;
+
+          sub_texture = cogl_sub_texture_new (cogl_context,
+                                              COGL_TEXTURE (atlas->texture),
+                                              atlas->frame_x[cursor][i],
+                                              atlas->frame_y[cursor][i],
+                                              images->images[i]->width,
+                                              images->images[i]->height);
+          atlas->frame_textures[cursor][i] = COGL_TEXTURE (sub_texture);
+        }
+    }
+
+  meta_verbose ("Cursor atlas for theme %s size %d scale %d: %dx%d\n",
+                atlas->theme, atlas->size, atlas->scale,
+                atlas->width, atlas->height);
+
+ out:
+  /* Drop the reference taken for the build; this is done here rather
+   * than by the task, whose last reference may go away in the worker. */
+  meta_cursor_atlas_unref (atlas);
+}
+
+static void
+start_cursor_atlas (const char *theme,
+                    int         size,
+                    int         scale)
+{
+  MetaCursorAtlas *atlas;
+  GTask *task;
+
+  atlas = g_slice_new0 (MetaCursorAtlas);
+  atlas->ref_count = 2; /* the table's and the build's */
+  atlas->theme = g_strdup (theme);
+  atlas->size = size;
+  atlas->scale = scale;
+
+  g_hash_table_insert (cursor_atlases,
+                       cursor_atlas_key (theme, size, scale),
+                       atlas);
+
+  task = g_task_new (NULL, NULL, on_cursor_atlas_built, NULL);
+  g_task_set_task_data (task, atlas, NULL);
+  g_task_run_in_thread (task, build_cursor_atlas_thread);
+  g_object_unref (task);
+}
+
+/**
+ * meta_cursor_sprite_preload_theme: (skip)
+ * @scales: the monitor scales theme cursors are needed at
+ * @n_scales: the number of scales
+ *
+ * Starts building the cursor atlases for the current cursor theme and
+ * size at @scales in the background, and drops the atlases of any
+ * previous theme. Sprites keep loading their cursor directly until the
+ * atlas they need is ready, and never use atlases if this is not
+ * called.
+ */
+void
+meta_cursor_sprite_preload_theme (const int *scales,
+                                  int        n_scales)
+{
+  const char *theme = meta_prefs_get_cursor_theme ();
+  int size = meta_prefs_get_cursor_size ();
+  GHashTableIter iter;
+  MetaCursorAtlas *atlas;
+  int i;
+
+  ensure_cursor_atlases ();
+
+  g_hash_table_iter_init (&iter, cursor_atlases);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &atlas))
+    {
+      if (g_strcmp0 (atlas->theme, theme) != 0 || atlas->size != size)
+        g_hash_table_iter_remove (&iter);
+    }
+
+  for (i = 0; i < n_scales; i++)
+    {
+      char *key = cursor_atlas_key (theme, size, scales[i]);
+
+      if (!g_hash_table_contains (cursor_atlases, key))
+        start_cursor_atlas (theme, size, scales[i]);
+
+      g_free (key);
+    }
+}
+
 static void
 meta_cursor_sprite_load_from_xcursor_image (MetaCursorSprite *self,
                                             XcursorImage     *xc_image)
@@ -139,6 +492,17 @@ meta_cursor_sprite_load_from_xcursor_image (MetaCursorSprite *self,
 
   g_assert (self->texture == NULL);
 
+  if (self->atlas)
+    {
+      CoglTexture *frame_texture =
+        self->atlas->frame_textures[self->cursor][self->current_frame];
+
+      meta_cursor_sprite_set_texture (self, frame_texture,
+                                      xc_image->xhot, xc_image->yhot);
+      meta_cursor_renderer_realize_cursor_from_xcursor (renderer, self, xc_image);
+      return;
+    }
+
   width           = xc_image->width;
   height          = xc_image->height;
   rowstride       = width * 4;
@@ -222,14 +586,27 @@ meta_cursor_sprite_load_from_theme (MetaCursorSprite *self)
   if (self->xcursor_images)
     {
       g_clear_pointer (&self->texture, cogl_object_unref);
-      XcursorImagesDestroy (self->xcursor_images);
+      if (self->atlas)
+        g_clear_pointer (&self->atlas, meta_cursor_atlas_unref);
+      else
+        XcursorImagesDestroy (self->xcursor_images);
+      self->xcursor_images = NULL;
     }
 
   self->current_frame = 0;
-  self->xcursor_images = load_cursor_on_client (self->cursor,
-                                                self->theme_scale);
-  if (!self->xcursor_images)
-    meta_fatal ("Could not find cursor. Perhaps set XCURSOR_PATH?");
+
+  self->atlas = lookup_cursor_atlas (self->cursor, self->theme_scale);
+  if (self->atlas)
+    {
+      self->xcursor_images = self->atlas->images[self->cursor];
+    }
+  else
+    {
+      self->xcursor_images = load_cursor_on_client (self->cursor,
+                                                    self->theme_scale);
+      if (!self->xcursor_images)
+        meta_fatal ("Could not find cursor. Perhaps set XCURSOR_PATH?");
+    }
 
   image = meta_cursor_sprite_get_current_frame_image (self);
   meta_cursor_sprite_load_from_xcursor_image (self, image);
@@ -332,7 +709,9 @@ meta_cursor_sprite_finalize (GObject *object)
 {
   MetaCursorSprite *self = META_CURSOR_SPRITE (object);
 
-  if (self->xcursor_images)
+  if (self->atlas)
+    meta_cursor_atlas_unref (self->atlas);
+  else if (self->xcursor_images)
     XcursorImagesDestroy (self->xcursor_images);
 
   g_clear_pointer (&self->texture, cogl_object_unref);
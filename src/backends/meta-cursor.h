@@ -37,6 +37,9 @@ MetaCursorSprite * meta_cursor_sprite_new (void);
 
 MetaCursorSprite * meta_cursor_sprite_from_theme  (MetaCursor cursor);
 
+void meta_cursor_sprite_preload_theme (const int *scales,
+                                       int        n_scales);
+
 
 void meta_cursor_sprite_set_theme_scale (MetaCursorSprite *self,
                                          int               scale);
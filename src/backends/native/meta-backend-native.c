@@ -45,11 +45,43 @@ struct _MetaBackendNativePrivate
   guint sleep_signal_id;
   GCancellable *cancellable;
   GDBusConnection *system_bus;
+
+  /* CachedKeymap, most recently used first */
+  GQueue keymap_cache;
+  guint keymap_serial;
+  gboolean keymap_set;
 };
 typedef struct _MetaBackendNativePrivate MetaBackendNativePrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (MetaBackendNative, meta_backend_native, META_TYPE_BACKEND);
 
+/* Number of compiled keymaps kept around, so that switching back and
+ * forth between a few layouts doesn't recompile them each time */
+#define KEYMAP_CACHE_SIZE 4
+
+typedef struct
+{
+  char *layouts;
+  char *variants;
+  char *options;
+
+  /* NULL while the keymap is being compiled */
+  struct xkb_keymap *keymap;
+  /* keymap_serial of the last request for this keymap */
+  guint serial;
+} CachedKeymap;
+
+static void
+cached_keymap_free (CachedKeymap *cached)
+{
+  g_free (cached->layouts);
+  g_free (cached->variants);
+  g_free (cached->options);
+  if (cached->keymap)
+    xkb_keymap_unref (cached->keymap);
+  g_slice_free (CachedKeymap, cached);
+}
+
 static void
 meta_backend_native_finalize (GObject *object)
 {
@@ -65,6 +97,9 @@ meta_backend_native_finalize (GObject *object)
   g_clear_object (&priv->cancellable);
   g_clear_object (&priv->system_bus);
 
+  g_queue_foreach (&priv->keymap_cache, (GFunc) cached_keymap_free, NULL);
+  g_queue_clear (&priv->keymap_cache);
+
   G_OBJECT_CLASS (meta_backend_native_parent_class)->finalize (object);
 }
 
@@ -260,13 +295,11 @@ meta_backend_native_warp_pointer (MetaBackend *backend,
   clutter_evdev_warp_pointer (device, time_, x, y);
 }
 
-static void
-meta_backend_native_set_keymap (MetaBackend *backend,
-                                const char  *layouts,
-                                const char  *variants,
-                                const char  *options)
+static struct xkb_keymap *
+compile_keymap (const char *layouts,
+                const char *variants,
+                const char *options)
 {
-  ClutterDeviceManager *manager = clutter_device_manager_get_default ();
   struct xkb_rule_names names;
   struct xkb_keymap *keymap;
   struct xkb_context *context;
@@ -281,11 +314,166 @@ meta_backend_native_set_keymap (MetaBackend *backend,
   keymap = xkb_keymap_new_from_names (context, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
   xkb_context_unref (context);
 
+  return keymap;
+}
+
+static void
+apply_keymap (MetaBackend       *backend,
+              struct xkb_keymap *keymap)
+{
+  ClutterDeviceManager *manager = clutter_device_manager_get_default ();
+  MetaBackendNative *native = META_BACKEND_NATIVE (backend);
+  MetaBackendNativePrivate *priv = meta_backend_native_get_instance_private (native);
+
+  priv->keymap_set = TRUE;
+
   clutter_evdev_set_keyboard_map (manager, keymap);
 
   g_signal_emit_by_name (backend, "keymap-changed", 0);
+}
+
+static void
+trim_keymap_cache (MetaBackendNativePrivate *priv)
+{
+  GList *l, *prev;
+
+  /* Keymaps still being compiled are never evicted; their task refers
+   * to the cache entry. */
+  for (l = priv->keymap_cache.tail;
+       l != NULL && priv->keymap_cache.length > KEYMAP_CACHE_SIZE;
+       l = prev)
+    {
+      CachedKeymap *cached = l->data;
+
+      prev = l->prev;
+
+      if (cached->keymap == NULL)
+        continue;
+
+      cached_keymap_free (cached);
+      g_queue_delete_link (&priv->keymap_cache, l);
+    }
+}
+
+static void
+compile_keymap_thread (GTask        *task,
+                       gpointer      source_object,
+                       gpointer      task_data,
+                       GCancellable *cancellable)
+{
+  CachedKeymap *cached = task_data;
+  struct xkb_keymap *keymap;
+
+  /* Only the immutable RMLVO strings of the entry are used here */
+  keymap = compile_keymap (cached->layouts, cached->variants, cached->options);
+  g_task_return_pointer (task, keymap, (GDestroyNotify) xkb_keymap_unref);
+}
+
+static void
+on_keymap_compiled (GObject      *source_object,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+  MetaBackend *backend = META_BACKEND (source_object);
+  MetaBackendNative *native = META_BACKEND_NATIVE (backend);
+  MetaBackendNativePrivate *priv = meta_backend_native_get_instance_private (native);
+  CachedKeymap *cached = g_task_get_task_data (G_TASK (result));
+  struct xkb_keymap *keymap;
+
+  keymap = g_task_propagate_pointer (G_TASK (result), NULL);
+  if (keymap == NULL)
+    {
+      g_warning ("Failed to compile keymap for layouts '%s', variants '%s', options '%s'",
+                 cached->layouts, cached->variants, cached->options);
+      g_queue_remove (&priv->keymap_cache, cached);
+      cached_keymap_free (cached);
+      return;
+    }
+
+  cached->keymap = keymap;
+
+  /* Another keymap may have been asked for in the meantime */
+  if (cached->serial == priv->keymap_serial)
+    apply_keymap (backend, keymap);
+
+  trim_keymap_cache (priv);
+}
+
+static CachedKeymap *
+lookup_cached_keymap (MetaBackendNativePrivate *priv,
+                      const char               *layouts,
+                      const char               *variants,
+                      const char               *options)
+{
+  GList *l;
+
+  for (l = priv->keymap_cache.head; l; l = l->next)
+    {
+      CachedKeymap *cached = l->data;
+
+      if (g_strcmp0 (cached->layouts, layouts) == 0 &&
+          g_strcmp0 (cached->variants, variants) == 0 &&
+          g_strcmp0 (cached->options, options) == 0)
+        {
+          g_queue_unlink (&priv->keymap_cache, l);
+          g_queue_push_head_link (&priv->keymap_cache, l);
+          return cached;
+        }
+    }
+
+  return NULL;
+}
+
+static void
+meta_backend_native_set_keymap (MetaBackend *backend,
+                                const char  *layouts,
+                                const char  *variants,
+                                const char  *options)
+{
+  MetaBackendNative *native = META_BACKEND_NATIVE (backend);
+  MetaBackendNativePrivate *priv = meta_backend_native_get_instance_private (native);
+  CachedKeymap *cached;
+  GTask *task;
+
+  priv->keymap_serial++;
+
+  cached = lookup_cached_keymap (priv, layouts, variants, options);
+  if (cached)
+    {
+      cached->serial = priv->keymap_serial;
+
+      /* If it is still compiling, it gets applied once done */
+      if (cached->keymap)
+        apply_keymap (backend, cached->keymap);
+      return;
+    }
+
+  cached = g_slice_new0 (CachedKeymap);
+  cached->layouts = g_strdup (layouts);
+  cached->variants = g_strdup (variants);
+  cached->options = g_strdup (options);
+  cached->serial = priv->keymap_serial;
+
+  /* The first keymap is needed before we can handle any key event, so
+   * there is nothing to gain by compiling it in the background. */
+  if (!priv->keymap_set)
+    {
+      cached->keymap = compile_keymap (layouts, variants, options);
+      apply_keymap (backend, cached->keymap);
+
+      if (cached->keymap)
+        g_queue_push_head (&priv->keymap_cache, cached);
+      else
+        cached_keymap_free (cached);
+      return;
+    }
+
+  g_queue_push_head (&priv->keymap_cache, cached);
 
-  xkb_keymap_unref (keymap);
+  task = g_task_new (backend, NULL, on_keymap_compiled, NULL);
+  g_task_set_task_data (task, cached, NULL);
+  g_task_run_in_thread (task, compile_keymap_thread);
+  g_object_unref (task);
 }
 
 static struct xkb_keymap *
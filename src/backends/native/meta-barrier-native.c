@@ -30,6 +30,7 @@
 
 #include "config.h"
 
+#include <math.h>
 #include <stdlib.h>
 
 #include <meta/barrier.h>
@@ -40,9 +41,20 @@
 #include "backends/native/meta-backend-native-private.h"
 #include "backends/native/meta-barrier-native.h"
 
+/* Barriers are indexed in a uniform grid of square cells, so that a motion
+ * only needs to be tested against the barriers in the cells its bounding
+ * box covers. */
+#define GRID_CELL_SIZE 256
+
 struct _MetaBarrierManagerNative
 {
   GHashTable *barriers;
+
+  /* cell key -> GPtrArray of the MetaBarrierImplNative crossing the cell */
+  GHashTable *grid;
+  /* Barriers in any state but META_BARRIER_STATE_ACTIVE */
+  GHashTable *engaged_barriers;
+  guint query_serial;
 };
 
 typedef enum {
@@ -74,6 +86,9 @@ struct _MetaBarrierImplNativePrivate
   int                       trigger_serial;
   guint32                   last_event_time;
   MetaBarrierDirection      blocked_dir;
+
+  /* query_serial of the last grid query that tested this barrier */
+  guint                     query_serial;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (MetaBarrierImplNative, meta_barrier_impl_native,
@@ -279,6 +294,88 @@ is_within_box (Line2 box, Vector2 point)
           point.y >= box.a.y && point.y < box.b.y);
 }
 
+static int
+grid_cell_index (float coordinate)
+{
+  return (int) floorf (coordinate / GRID_CELL_SIZE);
+}
+
+static gpointer
+grid_cell_key (int cell_x,
+               int cell_y)
+{
+  return GUINT_TO_POINTER (((guint) (cell_x & 0xffff) << 16) |
+                           (guint) (cell_y & 0xffff));
+}
+
+static void
+get_barrier_cells (MetaBarrier *barrier,
+                   int         *cell_x1,
+                   int         *cell_y1,
+                   int         *cell_x2,
+                   int         *cell_y2)
+{
+  Line2 line = barrier_to_line (barrier);
+
+  *cell_x1 = grid_cell_index (line.a.x);
+  *cell_y1 = grid_cell_index (line.a.y);
+  *cell_x2 = grid_cell_index (line.b.x);
+  *cell_y2 = grid_cell_index (line.b.y);
+}
+
+static void
+grid_add_barrier (MetaBarrierManagerNative *manager,
+                  MetaBarrierImplNative    *self)
+{
+  MetaBarrierImplNativePrivate *priv =
+    meta_barrier_impl_native_get_instance_private (self);
+  int cell_x1, cell_y1, cell_x2, cell_y2;
+  int cell_x, cell_y;
+
+  get_barrier_cells (priv->barrier, &cell_x1, &cell_y1, &cell_x2, &cell_y2);
+
+  for (cell_y = cell_y1; cell_y <= cell_y2; cell_y++)
+    for (cell_x = cell_x1; cell_x <= cell_x2; cell_x++)
+      {
+        gpointer key = grid_cell_key (cell_x, cell_y);
+        GPtrArray *cell = g_hash_table_lookup (manager->grid, key);
+
+        if (cell == NULL)
+          {
+            cell = g_ptr_array_new ();
+            g_hash_table_insert (manager->grid, key, cell);
+          }
+
+        g_ptr_array_add (cell, self);
+      }
+}
+
+static void
+grid_remove_barrier (MetaBarrierManagerNative *manager,
+                     MetaBarrierImplNative    *self)
+{
+  MetaBarrierImplNativePrivate *priv =
+    meta_barrier_impl_native_get_instance_private (self);
+  int cell_x1, cell_y1, cell_x2, cell_y2;
+  int cell_x, cell_y;
+
+  get_barrier_cells (priv->barrier, &cell_x1, &cell_y1, &cell_x2, &cell_y2);
+
+  for (cell_y = cell_y1; cell_y <= cell_y2; cell_y++)
+    for (cell_x = cell_x1; cell_x <= cell_x2; cell_x++)
+      {
+        gpointer key = grid_cell_key (cell_x, cell_y);
+        GPtrArray *cell = g_hash_table_lookup (manager->grid, key);
+
+        if (cell == NULL)
+          continue;
+
+        g_ptr_array_remove_fast (cell, self);
+        if (cell->len == 0)
+          g_hash_table_remove (manager->grid, key);
+      }
+}
+
 static void
 maybe_release_barrier (gpointer key,
                        gpointer value,
@@ -341,7 +438,8 @@ maybe_release_barriers (MetaBarrierManagerNative *manager,
     },
   };
 
-  g_hash_table_foreach (manager->barriers,
+  /* Only held barriers can be released */
+  g_hash_table_foreach (manager->engaged_barriers,
                         maybe_release_barrier,
                         &motion);
 }
@@ -427,6 +525,8 @@ get_closest_barrier (MetaBarrierManagerNative *manager,
                      MetaBarrierImplNative   **barrier_impl)
 {
   MetaClosestBarrierData closest_barrier_data;
+  int cell_x1, cell_y1, cell_x2, cell_y2;
+  gint64 n_cells;
 
   closest_barrier_data = (MetaClosestBarrierData) {
     .in = {
@@ -444,9 +544,53 @@ get_closest_barrier (MetaBarrierManagerNative *manager,
     },
   };
 
-  g_hash_table_foreach (manager->barriers,
-                        update_closest_barrier,
-                        &closest_barrier_data);
+  cell_x1 = grid_cell_index (MIN (prev_x, x));
+  cell_y1 = grid_cell_index (MIN (prev_y, y));
+  cell_x2 = grid_cell_index (MAX (prev_x, x));
+  cell_y2 = grid_cell_index (MAX (prev_y, y));
+
+  n_cells = (gint64) (cell_x2 - cell_x1 + 1) * (cell_y2 - cell_y1 + 1);
+
+  if (n_cells > g_hash_table_size (manager->grid))
+    {
+      /* A long jump covering more cells than there are in use; testing
+       * every barrier is cheaper than walking the empty cells. */
+      g_hash_table_foreach (manager->barriers,
+                            update_closest_barrier,
+                            &closest_barrier_data);
+    }
+  else
+    {
+      int cell_x, cell_y;
+      guint i;
+
+      /* A barrier crossing several cells must only be tested once */
+      manager->query_serial++;
+
+      for (cell_y = cell_y1; cell_y <= cell_y2; cell_y++)
+        for (cell_x = cell_x1; cell_x <= cell_x2; cell_x++)
+          {
+            GPtrArray *cell;
+
+            cell = g_hash_table_lookup (manager->grid,
+                                        grid_cell_key (cell_x, cell_y));
+            if (cell == NULL)
+              continue;
+
+            for (i = 0; i < cell->len; i++)
+              {
+                MetaBarrierImplNative *self = g_ptr_array_index (cell, i);
+                MetaBarrierImplNativePrivate *priv =
+                  meta_barrier_impl_native_get_instance_private (self);
+
+                if (priv->query_serial == manager->query_serial)
+                  continue;
+
+                priv->query_serial = manager->query_serial;
+                update_closest_barrier (self, NULL, &closest_barrier_data);
+              }
+          }
+    }
 
   if (closest_barrier_data.out.barrier_impl != NULL)
     {
@@ -497,6 +641,7 @@ emit_barrier_event (MetaBarrierImplNative *self,
     case META_BARRIER_STATE_RELEASE:
     case META_BARRIER_STATE_LEFT:
       priv->state = META_BARRIER_STATE_ACTIVE;
+      g_hash_table_remove (priv->manager->engaged_barriers, self);
 
       /* Intentional fall-through. */
     case META_BARRIER_STATE_HELD:
@@ -593,6 +738,7 @@ clamp_to_barrier (MetaBarrierImplNative *self,
     }
 
   priv->state = META_BARRIER_STATE_HIT;
+  g_hash_table_add (priv->manager->engaged_barriers, self);
 }
 
 void
@@ -610,6 +756,7 @@ meta_barrier_manager_native_process (MetaBarrierManagerNative *manager,
   MetaBarrierDirection motion_dir = 0;
   MetaBarrierEventData barrier_event_data;
   MetaBarrierImplNative *barrier_impl;
+  GList *engaged, *l;
 
   if (!clutter_input_device_get_coords (device, NULL, &prev_pos))
     return;
@@ -655,9 +802,22 @@ meta_barrier_manager_native_process (MetaBarrierManagerNative *manager,
     .dy = orig_y - prev_y,
   };
 
-  g_hash_table_foreach (manager->barriers,
-                        maybe_emit_barrier_event,
-                        &barrier_event_data);
+  /* Barriers in the active state have nothing to report. Emitting may
+   * change the engaged set, or destroy barriers, so walk a snapshot. */
+  engaged = g_hash_table_get_keys (manager->engaged_barriers);
+  g_list_foreach (engaged, (GFunc) g_object_ref, NULL);
+
+  for (l = engaged; l; l = l->next)
+    {
+      MetaBarrierImplNative *self = l->data;
+      MetaBarrierImplNativePrivate *priv =
+        meta_barrier_impl_native_get_instance_private (self);
+
+      if (priv->is_active)
+        maybe_emit_barrier_event (self, NULL, &barrier_event_data);
+    }
+
+  g_list_free_full (engaged, g_object_unref);
 }
 
 static gboolean
@@ -691,6 +851,8 @@ _meta_barrier_impl_native_destroy (MetaBarrierImpl *impl)
     meta_barrier_impl_native_get_instance_private (self);
 
   g_hash_table_remove (priv->manager->barriers, self);
+  g_hash_table_remove (priv->manager->engaged_barriers, self);
+  grid_remove_barrier (priv->manager, self);
   priv->is_active = FALSE;
 }
 
@@ -712,6 +874,7 @@ meta_barrier_impl_native_new (MetaBarrier *barrier)
   manager = meta_backend_native_get_barrier_manager (native);
   priv->manager = manager;
   g_hash_table_add (manager->barriers, self);
+  grid_add_barrier (manager, self);
 
   return META_BARRIER_IMPL (self);
 }
@@ -739,6 +902,9 @@ meta_barrier_manager_native_new (void)
   manager = g_new0 (MetaBarrierManagerNative, 1);
 
   manager->barriers = g_hash_table_new (NULL, NULL);
+  manager->grid = g_hash_table_new_full (NULL, NULL, NULL,
+                                         (GDestroyNotify) g_ptr_array_unref);
+  manager->engaged_barriers = g_hash_table_new (NULL, NULL);
 
   return manager;
 }
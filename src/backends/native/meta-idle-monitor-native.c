@@ -35,6 +35,20 @@ struct _MetaIdleMonitorNative
   MetaIdleMonitor parent;
 
   guint64 last_event_time;
+
+  /* All idle watches share the same epoch, last_event_time, so their
+   * deadlines are ordered by timeout alone and user activity doesn't
+   * change that order. Watches with a timeout are kept sorted by it and
+   * served by a single timer; resetting the idle time only starts a new
+   * epoch, without touching any watch. */
+  GPtrArray *timed_watches;
+  /* Index of the first timed watch that may not have fired in this epoch */
+  guint next_watch;
+  guint epoch;
+  GSource *timeout_source;
+
+  /* Watches with a zero timeout, fired on the next user activity */
+  GList *user_active_watches;
 };
 
 struct _MetaIdleMonitorNativeClass
@@ -45,7 +59,8 @@ struct _MetaIdleMonitorNativeClass
 typedef struct {
   MetaIdleMonitorWatch base;
 
-  GSource *timeout_source;
+  /* epoch the watch last fired in */
+  guint fired_epoch;
 } MetaIdleMonitorWatchNative;
 
 G_DEFINE_TYPE (MetaIdleMonitorNative, meta_idle_monitor_native, META_TYPE_IDLE_MONITOR)
@@ -66,16 +81,74 @@ get_next_watch_serial (void)
   return serial;
 }
 
+static gint64
+get_watch_deadline (MetaIdleMonitorNative      *monitor_native,
+                    MetaIdleMonitorWatchNative *watch_native)
+{
+  MetaIdleMonitorWatch *watch = (MetaIdleMonitorWatch *) watch_native;
+
+  return monitor_native->last_event_time + watch->timeout_msec * 1000;
+}
+
+static MetaIdleMonitorWatchNative *
+get_next_pending_watch (MetaIdleMonitorNative *monitor_native)
+{
+  GPtrArray *timed_watches = monitor_native->timed_watches;
+
+  while (monitor_native->next_watch < timed_watches->len)
+    {
+      MetaIdleMonitorWatchNative *watch_native =
+        g_ptr_array_index (timed_watches, monitor_native->next_watch);
+
+      if (watch_native->fired_epoch != monitor_native->epoch)
+        return watch_native;
+
+      monitor_native->next_watch++;
+    }
+
+  return NULL;
+}
+
+static void
+update_timeout (MetaIdleMonitorNative *monitor_native)
+{
+  MetaIdleMonitorWatchNative *watch_native;
+
+  watch_native = get_next_pending_watch (monitor_native);
+  if (watch_native)
+    g_source_set_ready_time (monitor_native->timeout_source,
+                             get_watch_deadline (monitor_native, watch_native));
+  else
+    g_source_set_ready_time (monitor_native->timeout_source, -1);
+}
+
 static gboolean
 native_dispatch_timeout (GSource     *source,
                          GSourceFunc  callback,
                          gpointer     user_data)
 {
-  MetaIdleMonitorWatchNative *watch_native = user_data;
-  MetaIdleMonitorWatch *watch = (MetaIdleMonitorWatch *) watch_native;
+  MetaIdleMonitorNative *monitor_native = user_data;
+  MetaIdleMonitorWatchNative *watch_native;
+  gint64 now = g_get_monotonic_time ();
+
+  g_object_ref (monitor_native);
+
+  /* Firing a watch may add or remove watches, so look up the next one
+   * again every time. */
+  while ((watch_native = get_next_pending_watch (monitor_native)) != NULL &&
+         get_watch_deadline (monitor_native, watch_native) <= now)
+    {
+      watch_native->fired_epoch = monitor_native->epoch;
+      monitor_native->next_watch++;
+
+      _meta_idle_monitor_watch_fire ((MetaIdleMonitorWatch *) watch_native);
+    }
+
+  if (monitor_native->timeout_source)
+    update_timeout (monitor_native);
+
+  g_object_unref (monitor_native);
 
-  _meta_idle_monitor_watch_fire (watch);
-  g_source_set_ready_time (watch_native->timeout_source, -1);
   return TRUE;
 }
 
@@ -86,12 +159,88 @@ static GSourceFuncs native_source_funcs = {
   NULL, /* finalize */
 };
 
+static gint
+compare_watch_timeouts (gconstpointer a,
+                        gconstpointer b)
+{
+  const MetaIdleMonitorWatch *watch_a = a;
+  const MetaIdleMonitorWatch *watch_b = b;
+
+  if (watch_a->timeout_msec != watch_b->timeout_msec)
+    return watch_a->timeout_msec < watch_b->timeout_msec ? -1 : 1;
+
+  return 0;
+}
+
+static void
+add_timed_watch (MetaIdleMonitorNative      *monitor_native,
+                 MetaIdleMonitorWatchNative *watch_native)
+{
+  GPtrArray *timed_watches = monitor_native->timed_watches;
+  guint low = 0, high = timed_watches->len;
+  guint i;
+
+  /* Insert after the watches with the same timeout, so that watches
+   * fire in the order they were added. */
+  while (low < high)
+    {
+      guint mid = (low + high) / 2;
+
+      if (compare_watch_timeouts (g_ptr_array_index (timed_watches, mid),
+                                  watch_native) <= 0)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+  g_ptr_array_add (timed_watches, NULL);
+  for (i = timed_watches->len - 1; i > low; i--)
+    timed_watches->pdata[i] = timed_watches->pdata[i - 1];
+  timed_watches->pdata[low] = watch_native;
+
+  /* A watch whose deadline has already passed in this epoch fires as
+   * soon as possible, like any other. */
+  if (low < monitor_native->next_watch)
+    monitor_native->next_watch = low;
+  else if (low == monitor_native->next_watch)
+    ; /* it is next in line */
+  else
+    return;
+
+  update_timeout (monitor_native);
+}
+
+static void
+remove_timed_watch (MetaIdleMonitorNative      *monitor_native,
+                    MetaIdleMonitorWatchNative *watch_native)
+{
+  GPtrArray *timed_watches = monitor_native->timed_watches;
+  guint i;
+
+  for (i = 0; i < timed_watches->len; i++)
+    {
+      if (g_ptr_array_index (timed_watches, i) == watch_native)
+        break;
+    }
+
+  if (i == timed_watches->len)
+    return;
+
+  g_ptr_array_remove_index (timed_watches, i);
+
+  if (i < monitor_native->next_watch)
+    monitor_native->next_watch--;
+  else if (i == monitor_native->next_watch && monitor_native->timeout_source)
+    update_timeout (monitor_native);
+}
+
 static void
 free_watch (gpointer data)
 {
   MetaIdleMonitorWatchNative *watch_native = data;
   MetaIdleMonitorWatch *watch = (MetaIdleMonitorWatch *) watch_native;
   MetaIdleMonitor *monitor = watch->monitor;
+  MetaIdleMonitorNative *monitor_native = META_IDLE_MONITOR_NATIVE (monitor);
 
   g_object_ref (monitor);
 
@@ -104,8 +253,11 @@ free_watch (gpointer data)
   if (watch->notify != NULL)
     watch->notify (watch->user_data);
 
-  if (watch_native->timeout_source != NULL)
-    g_source_destroy (watch_native->timeout_source);
+  if (watch->timeout_msec != 0)
+    remove_timed_watch (monitor_native, watch_native);
+  else
+    monitor_native->user_active_watches =
+      g_list_remove (monitor_native->user_active_watches, watch_native);
 
   g_object_unref (monitor);
   g_slice_free (MetaIdleMonitorWatchNative, watch_native);
@@ -132,26 +284,56 @@ meta_idle_monitor_native_make_watch (MetaIdleMonitor           *monitor,
   watch->notify = notify;
   watch->timeout_msec = timeout_msec;
 
+  /* Never fired yet in the current epoch */
+  watch_native->fired_epoch = monitor_native->epoch - 1;
+
   if (timeout_msec != 0)
-    {
-      GSource *source = g_source_new (&native_source_funcs, sizeof (GSource));
+    add_timed_watch (monitor_native, watch_native);
+  else
+    monitor_native->user_active_watches =
+      g_list_prepend (monitor_native->user_active_watches, watch_native);
+
+  return watch;
+}
+
+static void
+meta_idle_monitor_native_dispose (GObject *object)
+{
+  MetaIdleMonitor *monitor = META_IDLE_MONITOR (object);
+  MetaIdleMonitorNative *monitor_native = META_IDLE_MONITOR_NATIVE (object);
 
-      g_source_set_callback (source, NULL, watch, NULL);
-      g_source_set_ready_time (source, monitor_native->last_event_time + timeout_msec * 1000);
-      g_source_attach (source, NULL);
-      g_source_unref (source);
+  /* Free the watches while the timer and the watch lists still exist */
+  g_clear_pointer (&monitor->watches, g_hash_table_destroy);
 
-      watch_native->timeout_source = source;
+  if (monitor_native->timeout_source)
+    {
+      g_source_destroy (monitor_native->timeout_source);
+      g_clear_pointer (&monitor_native->timeout_source, g_source_unref);
     }
 
-  return watch;
+  G_OBJECT_CLASS (meta_idle_monitor_native_parent_class)->dispose (object);
+}
+
+static void
+meta_idle_monitor_native_finalize (GObject *object)
+{
+  MetaIdleMonitorNative *monitor_native = META_IDLE_MONITOR_NATIVE (object);
+
+  g_ptr_array_free (monitor_native->timed_watches, TRUE);
+  g_list_free (monitor_native->user_active_watches);
+
+  G_OBJECT_CLASS (meta_idle_monitor_native_parent_class)->finalize (object);
 }
 
 static void
 meta_idle_monitor_native_class_init (MetaIdleMonitorNativeClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   MetaIdleMonitorClass *idle_monitor_class = META_IDLE_MONITOR_CLASS (klass);
 
+  object_class->dispose = meta_idle_monitor_native_dispose;
+  object_class->finalize = meta_idle_monitor_native_finalize;
+
   idle_monitor_class->get_idletime = meta_idle_monitor_native_get_idletime;
   idle_monitor_class->make_watch = meta_idle_monitor_native_make_watch;
 }
@@ -160,39 +342,17 @@ static void
 meta_idle_monitor_native_init (MetaIdleMonitorNative *monitor_native)
 {
   MetaIdleMonitor *monitor = META_IDLE_MONITOR (monitor_native);
+  GSource *source;
 
   monitor->watches = g_hash_table_new_full (NULL, NULL, NULL, free_watch);
-}
-
-typedef struct {
-  MetaIdleMonitorNative *monitor_native;
-  GList *fired_watches;
-} CheckNativeClosure;
-
-static gboolean
-check_native_watch (gpointer key,
-                    gpointer value,
-                    gpointer user_data)
-{
-  MetaIdleMonitorWatchNative *watch_native = value;
-  MetaIdleMonitorWatch *watch = (MetaIdleMonitorWatch *) watch_native;
-  CheckNativeClosure *closure = user_data;
-  gboolean steal;
 
-  if (watch->timeout_msec == 0)
-    {
-      closure->fired_watches = g_list_prepend (closure->fired_watches, watch);
-      steal = TRUE;
-    }
-  else
-    {
-      g_source_set_ready_time (watch_native->timeout_source,
-                               closure->monitor_native->last_event_time +
-                               watch->timeout_msec * 1000);
-      steal = FALSE;
-    }
+  monitor_native->timed_watches = g_ptr_array_new ();
 
-  return steal;
+  source = g_source_new (&native_source_funcs, sizeof (GSource));
+  g_source_set_callback (source, NULL, monitor_native, NULL);
+  g_source_set_ready_time (source, -1);
+  g_source_attach (source, NULL);
+  monitor_native->timeout_source = source;
 }
 
 static void
@@ -206,14 +366,26 @@ void
 meta_idle_monitor_native_reset_idletime (MetaIdleMonitor *monitor)
 {
   MetaIdleMonitorNative *monitor_native = META_IDLE_MONITOR_NATIVE (monitor);
-  CheckNativeClosure closure;
+  GList *fired_watches, *l;
 
   monitor_native->last_event_time = g_get_monotonic_time ();
 
-  closure.monitor_native = monitor_native;
-  closure.fired_watches = NULL;
-  g_hash_table_foreach_steal (monitor->watches, check_native_watch, &closure);
+  monitor_native->epoch++;
+  monitor_native->next_watch = 0;
+  update_timeout (monitor_native);
+
+  /* User-active watches are one-shot; take them out of the watch table
+   * before firing, as before. */
+  fired_watches = monitor_native->user_active_watches;
+  monitor_native->user_active_watches = NULL;
+
+  for (l = fired_watches; l; l = l->next)
+    {
+      MetaIdleMonitorWatch *watch = l->data;
+
+      g_hash_table_steal (monitor->watches, GUINT_TO_POINTER (watch->id));
+    }
 
-  g_list_foreach (closure.fired_watches, fire_native_watch, NULL);
-  g_list_free (closure.fired_watches);
+  g_list_foreach (fired_watches, fire_native_watch, NULL);
+  g_list_free (fired_watches);
 }
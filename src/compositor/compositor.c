@@ -75,6 +75,7 @@
 #include <X11/extensions/shape.h>
 #include <X11/extensions/Xcomposite.h>
 #include "meta-sync-ring.h"
+#include "x11/roundtrip-audit.h"
 
 #include "backends/x11/meta-backend-x11.h"
 
@@ -352,7 +353,7 @@ meta_begin_modal_for_plugin (MetaCompositor   *compositor,
   XIUngrabDevice (display->xdisplay,
                   META_VIRTUAL_CORE_POINTER_ID,
                   timestamp);
-  XSync (display->xdisplay, False);
+  META_X_ROUNDTRIP ("XSync", XSync (display->xdisplay, False));
 
   if (!grab_devices (options, timestamp))
     return FALSE;
@@ -444,7 +445,7 @@ redirect_windows (MetaScreen *screen)
     {
       meta_error_trap_push (display);
       XCompositeRedirectSubwindows (xdisplay, xroot, CompositeRedirectManual);
-      XSync (xdisplay, FALSE);
+      META_X_ROUNDTRIP ("XSync", XSync (xdisplay, FALSE));
 
       if (!meta_error_trap_pop_with_return (display))
         break;
@@ -1095,7 +1096,7 @@ meta_pre_paint_func (gpointer data)
       if (compositor->have_x11_sync_object)
         compositor->have_x11_sync_object = meta_sync_ring_insert_wait ();
       else
-        XSync (compositor->display->xdisplay, False);
+        META_X_ROUNDTRIP ("XSync", XSync (compositor->display->xdisplay, False));
     }
 
   return TRUE;
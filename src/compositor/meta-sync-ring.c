@@ -40,6 +40,7 @@
 #include <meta/util.h>
 
 #include "meta-sync-ring.h"
+#include "x11/roundtrip-audit.h"
 
 /* Theory of operation:
  *
@@ -447,7 +448,7 @@ meta_sync_ring_init (Display *xdisplay)
   /* Since the connection we create the X fences on isn't the same as
    * the one used for the GLX context, we need to XSync() here to
    * ensure glImportSync() succeeds. */
-  XSync (xdisplay, False);
+  META_X_ROUNDTRIP ("XSync", XSync (xdisplay, False));
   for (i = 0; i < NUM_SYNCS; ++i)
     meta_sync_import (ring->syncs_array[i]);
 
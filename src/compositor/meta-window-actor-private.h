@@ -26,6 +26,7 @@ void meta_window_actor_size_change   (MetaWindowActor *self,
 
 void meta_window_actor_process_x11_damage (MetaWindowActor    *self,
                                            XDamageNotifyEvent *event);
+float meta_window_actor_get_damage_rate   (MetaWindowActor    *self);
 
 void meta_window_actor_pre_paint      (MetaWindowActor    *self);
 void meta_window_actor_post_paint     (MetaWindowActor    *self);
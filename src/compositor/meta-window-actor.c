@@ -17,6 +17,7 @@
 
 #include <meta/display.h>
 #include <meta/errors.h>
+#include <meta/util.h>
 #include "frame.h"
 #include <meta/window.h>
 #include <meta/meta-shaped-texture.h>
@@ -98,6 +99,16 @@ struct _MetaWindowActorPrivate
   GList            *frames;
   guint             freeze_count;
 
+  /* X damage received since the last frame; applied to the surface
+   * once, right before the frame is painted */
+  cairo_region_t   *pending_damage;
+  guint             pending_damage_later;
+
+  /* DamageNotify rate tracking, see update_damage_rate() */
+  gint64            damage_period_start;
+  guint             damage_events_in_period;
+  float             damage_rate;
+
   guint		    visible                : 1;
   guint		    disposed               : 1;
 
@@ -114,6 +125,9 @@ struct _MetaWindowActorPrivate
 
   guint             updates_frozen         : 1;
   guint             first_frame_state      : 2; /* FirstFrameState */
+
+  guint             pending_damage_all     : 1;
+  guint             whole_surface_damage   : 1;
 };
 
 typedef struct _FrameData FrameData;
@@ -467,6 +481,13 @@ meta_window_actor_dispose (GObject *object)
       priv->send_frame_messages_timer = 0;
     }
 
+  if (priv->pending_damage_later != 0)
+    {
+      meta_later_remove (priv->pending_damage_later);
+      priv->pending_damage_later = 0;
+    }
+
+  g_clear_pointer (&priv->pending_damage, cairo_region_destroy);
   g_clear_pointer (&priv->shape_region, cairo_region_destroy);
   g_clear_pointer (&priv->shadow_clip, cairo_region_destroy);
 
@@ -1606,18 +1627,195 @@ check_needs_shadow (MetaWindowActor *self)
     meta_shadow_unref (old_shadow);
 }
 
+/* Windows that post damage faster than this (in DamageNotify events per
+ * second) are switched to whole-surface damage; they go back to
+ * per-rectangle damage once they drop below the lower threshold. */
+#define WHOLE_SURFACE_DAMAGE_ENTER_RATE 480.0
+#define WHOLE_SURFACE_DAMAGE_LEAVE_RATE 120.0
+#define DAMAGE_RATE_PERIOD_US           G_USEC_PER_SEC
+
+/* A frame's damage is applied as a single full-surface update when it is
+ * split into more rectangles than this, or covers at least this much of
+ * the surface. */
+#define MAX_PENDING_DAMAGE_RECTS        16
+#define WHOLE_SURFACE_DAMAGE_COVERAGE   0.75
+
+static void
+update_damage_rate (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+  gint64 now = g_get_monotonic_time ();
+  gint64 elapsed;
+
+  if (priv->damage_period_start == 0)
+    priv->damage_period_start = now;
+
+  priv->damage_events_in_period++;
+
+  elapsed = now - priv->damage_period_start;
+  if (elapsed < DAMAGE_RATE_PERIOD_US)
+    return;
+
+  priv->damage_rate = (priv->damage_events_in_period * (float) G_USEC_PER_SEC) / elapsed;
+  priv->damage_events_in_period = 0;
+  priv->damage_period_start = now;
+
+  meta_topic (META_DEBUG_COMPOSITOR,
+              "Window %s: %.1f damage events/s%s\n",
+              priv->window->desc, priv->damage_rate,
+              priv->whole_surface_damage ? " (whole-surface)" : "");
+
+  if (!priv->whole_surface_damage &&
+      priv->damage_rate >= WHOLE_SURFACE_DAMAGE_ENTER_RATE)
+    {
+      priv->whole_surface_damage = TRUE;
+      meta_topic (META_DEBUG_COMPOSITOR,
+                  "Window %s: switching to whole-surface damage\n",
+                  priv->window->desc);
+    }
+  else if (priv->whole_surface_damage &&
+           priv->damage_rate < WHOLE_SURFACE_DAMAGE_LEAVE_RATE)
+    {
+      priv->whole_surface_damage = FALSE;
+      meta_topic (META_DEBUG_COMPOSITOR,
+                  "Window %s: switching back to per-rectangle damage\n",
+                  priv->window->desc);
+    }
+}
+
+static gboolean
+pending_damage_covers_surface (cairo_region_t *region,
+                               MetaRectangle  *buffer_rect)
+{
+  cairo_rectangle_int_t rect;
+  gint64 area = 0;
+  int i, n_rects;
+
+  n_rects = cairo_region_num_rectangles (region);
+  if (n_rects > MAX_PENDING_DAMAGE_RECTS)
+    return TRUE;
+
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_region_get_rectangle (region, i, &rect);
+      area += (gint64) rect.width * rect.height;
+    }
+
+  return area >= WHOLE_SURFACE_DAMAGE_COVERAGE *
+                 (gint64) buffer_rect->width * buffer_rect->height;
+}
+
+static void
+apply_pending_damage (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+  MetaRectangle buffer_rect;
+  gboolean damage_all;
+
+  if (priv->pending_damage_later != 0)
+    {
+      meta_later_remove (priv->pending_damage_later);
+      priv->pending_damage_later = 0;
+    }
+
+  if (!priv->pending_damage_all && priv->pending_damage == NULL)
+    return;
+
+  if (priv->surface)
+    {
+      meta_window_get_buffer_rect (priv->window, &buffer_rect);
+
+      damage_all = priv->pending_damage_all ||
+                   pending_damage_covers_surface (priv->pending_damage, &buffer_rect);
+
+      if (damage_all)
+        {
+          meta_surface_actor_process_damage (priv->surface, 0, 0,
+                                             buffer_rect.width,
+                                             buffer_rect.height);
+        }
+      else
+        {
+          cairo_rectangle_int_t rect;
+          int i, n_rects;
+
+          n_rects = cairo_region_num_rectangles (priv->pending_damage);
+          for (i = 0; i < n_rects; i++)
+            {
+              cairo_region_get_rectangle (priv->pending_damage, i, &rect);
+              meta_surface_actor_process_damage (priv->surface,
+                                                 rect.x, rect.y,
+                                                 rect.width, rect.height);
+            }
+        }
+    }
+
+  g_clear_pointer (&priv->pending_damage, cairo_region_destroy);
+  priv->pending_damage_all = FALSE;
+}
+
+static gboolean
+apply_pending_damage_later (gpointer data)
+{
+  MetaWindowActor *self = data;
+
+  self->priv->pending_damage_later = 0;
+  apply_pending_damage (self);
+
+  return G_SOURCE_REMOVE;
+}
+
 void
 meta_window_actor_process_x11_damage (MetaWindowActor    *self,
                                       XDamageNotifyEvent *event)
 {
   MetaWindowActorPrivate *priv = self->priv;
 
-  if (priv->surface)
-    meta_surface_actor_process_damage (priv->surface,
-                                       event->area.x,
-                                       event->area.y,
-                                       event->area.width,
-                                       event->area.height);
+  if (!priv->surface)
+    return;
+
+  update_damage_rate (self);
+
+  if (priv->whole_surface_damage)
+    {
+      priv->pending_damage_all = TRUE;
+      g_clear_pointer (&priv->pending_damage, cairo_region_destroy);
+    }
+  else if (!priv->pending_damage_all)
+    {
+      cairo_rectangle_int_t rect = {
+        event->area.x, event->area.y,
+        event->area.width, event->area.height
+      };
+
+      if (priv->pending_damage == NULL)
+        priv->pending_damage = cairo_region_create_rectangle (&rect);
+      else
+        cairo_region_union_rectangle (priv->pending_damage, &rect);
+    }
+
+  /* Nothing is queued for redraw until the damage is applied, so make
+   * sure a frame is scheduled to do that. */
+  if (priv->pending_damage_later == 0)
+    priv->pending_damage_later = meta_later_add (META_LATER_BEFORE_REDRAW,
+                                                 apply_pending_damage_later,
+                                                 self, NULL);
+}
+
+/**
+ * meta_window_actor_get_damage_rate:
+ * @self: a #MetaWindowActor
+ *
+ * Gets the rate at which the window posted X damage over the last
+ * measurement period, used to pick between per-rectangle and
+ * whole-surface damage.
+ *
+ * Return value: damage events per second
+ */
+float
+meta_window_actor_get_damage_rate (MetaWindowActor *self)
+{
+  return self->priv->damage_rate;
 }
 
 void
@@ -1922,6 +2120,7 @@ meta_window_actor_pre_paint (MetaWindowActor *self)
   if (meta_window_actor_is_destroyed (self))
     return;
 
+  apply_pending_damage (self);
   meta_window_actor_handle_updates (self);
 
   assign_frame_counter_to_frames (self);
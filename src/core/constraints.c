@@ -138,8 +138,30 @@ typedef struct
    */
   GList  *usable_screen_region;
   GList  *usable_monitor_region;
+
+  /* Whether the above came from the grab's MetaConstraintCache */
+  gboolean             from_cache;
 } ConstraintInfo;
 
+/* During a move or resize grab the grab window gets constrained on every
+ * motion event, but its work areas and the spanning rectangles of the
+ * active workspace can't change without one of the invalidation points
+ * (struts, monitors, workspace switch) being hit.  So we look them up once
+ * per monitor the window passes over and keep them until the grab ends.
+ */
+struct MetaConstraintCache
+{
+  MetaWindow     *window;
+  MetaWorkspace  *workspace;
+
+  GList          *usable_screen_region;
+
+  int             n_monitors;
+  gboolean       *monitor_cached;
+  MetaRectangle  *work_area_monitor;
+  GList         **usable_monitor_region;
+};
+
 static gboolean do_screen_and_monitor_relative_constraints (MetaWindow     *window,
                                                             GList          *region_spanning_rectangles,
                                                             ConstraintInfo *info,
@@ -195,6 +217,9 @@ static void setup_constraint_info        (ConstraintInfo      *info,
                                           int                  resize_gravity,
                                           const MetaRectangle *orig,
                                           MetaRectangle       *new);
+static void get_monitor_constraint_data  (MetaWindow     *window,
+                                          ConstraintInfo *info,
+                                          int             which_monitor);
 static void place_window_if_needed       (MetaWindow     *window,
                                           ConstraintInfo *info);
 static void update_onscreen_requirements (MetaWindow     *window,
@@ -274,6 +299,9 @@ meta_window_constrain (MetaWindow          *window,
   ConstraintInfo info;
   ConstraintPriority priority = PRIORITY_MINIMUM;
   gboolean satisfied = FALSE;
+#ifdef WITH_VERBOSE_MODE
+  gint64 start_time = g_get_monotonic_time ();
+#endif
 
   meta_topic (META_DEBUG_GEOMETRY,
               "Constraining %s in move from %d,%d %dx%d to %d,%d %dx%d\n",
@@ -312,6 +340,120 @@ meta_window_constrain (MetaWindow          *window,
    * if this was a user move or user move-and-resize operation.
    */
   update_onscreen_requirements (window, &info);
+
+#ifdef WITH_VERBOSE_MODE
+  meta_topic (META_DEBUG_GEOMETRY,
+              "Constraining %s took %" G_GINT64_FORMAT " us%s\n",
+              window->desc, g_get_monotonic_time () - start_time,
+              info.from_cache ? " (cached grab context)" : "");
+#endif
+}
+
+static MetaConstraintCache *
+ensure_constraint_cache (MetaWindow *window)
+{
+  MetaDisplay *display = window->display;
+  MetaWorkspace *cur_workspace = window->screen->active_workspace;
+  MetaConstraintCache *cache;
+
+  if (window != display->grab_window ||
+      display->event_route != META_EVENT_ROUTE_WINDOW_OP ||
+      cur_workspace == NULL)
+    return NULL;
+
+  cache = display->grab_constraint_cache;
+  if (cache != NULL &&
+      (cache->window != window || cache->workspace != cur_workspace))
+    {
+      meta_display_cleanup_constraint_cache (display);
+      cache = NULL;
+    }
+
+  if (cache == NULL)
+    {
+      int n_monitors = window->screen->n_monitor_infos;
+
+      cache = g_new0 (MetaConstraintCache, 1);
+      cache->window = window;
+      cache->workspace = cur_workspace;
+      cache->usable_screen_region =
+        meta_workspace_get_onscreen_region (cur_workspace);
+      cache->n_monitors = n_monitors;
+      cache->monitor_cached = g_new0 (gboolean, n_monitors);
+      cache->work_area_monitor = g_new0 (MetaRectangle, n_monitors);
+      cache->usable_monitor_region = g_new0 (GList *, n_monitors);
+
+      display->grab_constraint_cache = cache;
+
+      meta_topic (META_DEBUG_GEOMETRY,
+                  "Caching constraint context for %s\n", window->desc);
+    }
+
+  return cache;
+}
+
+/**
+ * meta_display_cleanup_constraint_cache:
+ * @display: a #MetaDisplay
+ *
+ * Drops the constraint context cached for the current grab, if any.  This
+ * must be called whenever the work areas of a workspace or the monitor
+ * layout change, since the cache holds on to pointers into the workspace's
+ * spanning rectangles.
+ */
+void
+meta_display_cleanup_constraint_cache (MetaDisplay *display)
+{
+  MetaConstraintCache *cache = display->grab_constraint_cache;
+
+  if (cache == NULL)
+    return;
+
+  g_free (cache->monitor_cached);
+  g_free (cache->work_area_monitor);
+  g_free (cache->usable_monitor_region);
+  g_free (cache);
+
+  display->grab_constraint_cache = NULL;
+}
+
+static void
+get_monitor_constraint_data (MetaWindow     *window,
+                             ConstraintInfo *info,
+                             int             which_monitor)
+{
+  MetaConstraintCache *cache;
+
+  cache = ensure_constraint_cache (window);
+  if (cache == NULL || which_monitor >= cache->n_monitors)
+    {
+      meta_window_get_work_area_for_monitor (window,
+                                             which_monitor,
+                                             &info->work_area_monitor);
+      info->usable_screen_region =
+        meta_workspace_get_onscreen_region (window->screen->active_workspace);
+      info->usable_monitor_region =
+        meta_workspace_get_onmonitor_region (window->screen->active_workspace,
+                                             which_monitor);
+      info->from_cache = FALSE;
+      return;
+    }
+
+  if (!cache->monitor_cached[which_monitor])
+    {
+      meta_window_get_work_area_for_monitor (window,
+                                             which_monitor,
+                                             &cache->work_area_monitor[which_monitor]);
+      cache->usable_monitor_region[which_monitor] =
+        meta_workspace_get_onmonitor_region (cache->workspace,
+                                             which_monitor);
+      cache->monitor_cached[which_monitor] = TRUE;
+    }
+
+  info->work_area_monitor = cache->work_area_monitor[which_monitor];
+  info->usable_screen_region = cache->usable_screen_region;
+  info->usable_monitor_region = cache->usable_monitor_region[which_monitor];
+  info->from_cache = TRUE;
 }
 
 static void
@@ -323,7 +465,6 @@ setup_constraint_info (ConstraintInfo      *info,
                        MetaRectangle       *new)
 {
   const MetaMonitorInfo *monitor_info;
-  MetaWorkspace *cur_workspace;
 
   info->orig    = *orig;
   info->current = *new;
@@ -372,9 +513,7 @@ setup_constraint_info (ConstraintInfo      *info,
 
   monitor_info =
     meta_screen_get_monitor_for_rect (window->screen, &info->current);
-  meta_window_get_work_area_for_monitor (window,
-                                         monitor_info->number,
-                                         &info->work_area_monitor);
+  get_monitor_constraint_data (window, info, monitor_info->number);
 
   if (!window->fullscreen || window->fullscreen_monitors[0] == -1)
     {
@@ -397,13 +536,6 @@ setup_constraint_info (ConstraintInfo      *info,
         }
     }
 
-  cur_workspace = window->screen->active_workspace;
-  info->usable_screen_region   =
-    meta_workspace_get_onscreen_region (cur_workspace);
-  info->usable_monitor_region =
-    meta_workspace_get_onmonitor_region (cur_workspace,
-                                         monitor_info->number);
-
   /* Log all this information for debugging */
   meta_topic (META_DEBUG_GEOMETRY,
               "Setting up constraint info:\n"
@@ -456,7 +588,6 @@ place_window_if_needed(MetaWindow     *window,
     {
       MetaRectangle orig_rect;
       MetaRectangle placed_rect;
-      MetaWorkspace *cur_workspace;
       const MetaMonitorInfo *monitor_info;
 
       meta_window_get_frame_rect (window, &placed_rect);
@@ -473,13 +604,7 @@ place_window_if_needed(MetaWindow     *window,
       monitor_info =
         meta_screen_get_monitor_for_rect (window->screen, &placed_rect);
       info->entire_monitor = monitor_info->rect;
-      meta_window_get_work_area_for_monitor (window,
-                                             monitor_info->number,
-                                             &info->work_area_monitor);
-      cur_workspace = window->screen->active_workspace;
-      info->usable_monitor_region =
-        meta_workspace_get_onmonitor_region (cur_workspace,
-                                             monitor_info->number);
+      get_monitor_constraint_data (window, info, monitor_info->number);
 
       info->current.x = placed_rect.x;
       info->current.y = placed_rect.y;
@@ -53,6 +53,7 @@ typedef struct _MetaGroupPropHooks  MetaGroupPropHooks;
 typedef struct _MetaWindowPropHooks MetaWindowPropHooks;
 
 typedef struct MetaEdgeResistanceData MetaEdgeResistanceData;
+typedef struct MetaConstraintCache    MetaConstraintCache;
 
 typedef enum {
   META_LIST_DEFAULT                   = 0,      /* normal windows */
@@ -145,6 +146,23 @@ struct _MetaDisplay
   /* last user interaction time in any app */
   guint32 last_user_time;
 
+  /* Managed, non-override-redirect windows ordered by user time, most
+   * recently used first; kept up to date by meta_display_update_window_mru()
+   */
+  GList *mru_list;
+
+  /* Every managed window, in no particular order; windows are added when
+   * they start being managed and dropped once they start unmanaging.
+   * stacked_windows is the same set bottom to top, rebuilt by
+   * meta_display_get_stacked_windows() only when the index or the
+   * stacking order changed.
+   */
+  GPtrArray *window_index;
+  guint window_index_serial;
+  GPtrArray *stacked_windows;
+  guint stacked_windows_index_serial;
+  guint64 stacked_windows_stack_serial;
+
   /* whether we're using mousenav (only relevant for sloppy&mouse focus modes;
    * !mouse_mode means "keynav mode")
    */
@@ -220,8 +238,11 @@ struct _MetaDisplay
   MetaRectangle grab_initial_window_pos;
   int         grab_initial_x, grab_initial_y;  /* These are only relevant for */
   gboolean    grab_threshold_movement_reached; /* raise_on_click == FALSE.    */
-  GTimeVal    grab_last_moveresize_time;
+  guint       grab_motion_later;
+  gint64      grab_pending_motion_time;
+  guint       grab_pending_motion_snap : 1;
   MetaEdgeResistanceData *grab_edge_resistance_data;
+  MetaConstraintCache    *grab_constraint_cache;
   unsigned int grab_last_user_action_was_snap;
 
   /* we use property updates as sentinels for certain window focus events
@@ -231,7 +252,6 @@ struct _MetaDisplay
 
   int         xkb_base_event_type;
   guint32     last_bell_time;
-  int	      grab_resize_timeout_id;
 
   MetaKeyBindingManager key_binding_manager;
 
@@ -244,6 +264,20 @@ struct _MetaDisplay
   /* Closing down the display */
   int closing;
 
+  /* Managed by errors.c: the request serial at which each trap that is
+   * currently pushed started, and how many error code queries had to
+   * block on a round trip or could be answered without one.
+   */
+  GArray *error_trap_serials;
+  guint n_error_trap_syncs;
+  guint n_error_trap_syncs_avoided;
+
+  /* Managed by x11/events.c: X events handed to us, and queued events
+   * folded into them before handling.
+   */
+  guint n_xevents_received;
+  guint n_xevents_compressed;
+
   /* Managed by group.c */
   GHashTable *groups_by_leader;
 
@@ -251,6 +285,9 @@ struct _MetaDisplay
   MetaWindowPropHooks *prop_hooks_table;
   GHashTable *prop_hooks;
   int n_prop_hooks;
+  GArray *pending_prop_reloads;
+  guint pending_prop_reloads_later;
+  guint n_coalesced_property_notifies;
 
   /* Managed by group-props.c */
   MetaGroupPropHooks *group_prop_hooks;
@@ -353,6 +390,17 @@ void        meta_display_register_stamp   (MetaDisplay *display,
 void        meta_display_unregister_stamp (MetaDisplay *display,
                                            guint64      stamp);
 
+void        meta_display_update_window_mru (MetaDisplay *display,
+                                            MetaWindow  *window);
+void        meta_display_remove_window_mru (MetaDisplay *display,
+                                            MetaWindow  *window);
+
+void        meta_display_add_window_to_index      (MetaDisplay *display,
+                                                   MetaWindow  *window);
+void        meta_display_remove_window_from_index (MetaDisplay *display,
+                                                   MetaWindow  *window);
+GPtrArray*  meta_display_get_stacked_windows      (MetaDisplay *display);
+
 /* A "stack id" is a XID or a stamp */
 
 #define META_STACK_ID_IS_X11(id) ((id) < G_GUINT64_CONSTANT(0x100000000))
@@ -405,8 +453,12 @@ void meta_display_grab_focus_window_button   (MetaDisplay *display,
 void meta_display_ungrab_focus_window_button (MetaDisplay *display,
                                               MetaWindow  *window);
 
-/* Next function is defined in edge-resistance.c */
+/* Next functions are defined in edge-resistance.c */
 void meta_display_cleanup_edges              (MetaDisplay *display);
+void meta_display_invalidate_workspace_edges (MetaDisplay *display);
+
+/* Next function is defined in constraints.c */
+void meta_display_cleanup_constraint_cache   (MetaDisplay *display);
 
 /* make a request to ensure the event serial has changed */
 void     meta_display_increment_event_serial (MetaDisplay *display);
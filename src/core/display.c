@@ -72,6 +72,7 @@
 #include "x11/window-props.h"
 #include "x11/group-props.h"
 #include "x11/xprops.h"
+#include "x11/roundtrip-audit.h"
 
 #ifdef HAVE_WAYLAND
 #include "wayland/meta-xwayland-private.h"
@@ -645,6 +646,11 @@ meta_display_open (void)
   display->stamps = g_hash_table_new (g_int64_hash,
                                       g_int64_equal);
   display->wayland_windows = g_hash_table_new (NULL, NULL);
+  display->window_index = g_ptr_array_new ();
+  display->window_index_serial = 1;
+  display->stacked_windows = g_ptr_array_new ();
+  display->stacked_windows_index_serial = 0;
+  display->stacked_windows_stack_serial = 0;
 
   i = 0;
   while (i < N_IGNORED_CROSSING_SERIALS)
@@ -656,7 +662,7 @@ meta_display_open (void)
   display->current_time = CurrentTime;
   display->sentinel_counter = 0;
 
-  display->grab_resize_timeout_id = 0;
+  display->grab_motion_later = 0;
   display->grab_have_keyboard = FALSE;
 
   display->last_bell_time = 0;
@@ -667,6 +673,7 @@ meta_display_open (void)
   display->grab_tile_monitor_number = -1;
 
   display->grab_edge_resistance_data = NULL;
+  display->grab_constraint_cache = NULL;
 
   {
     int major, minor;
@@ -979,17 +986,6 @@ meta_display_open (void)
   return TRUE;
 }
 
-static gint
-ptrcmp (gconstpointer a, gconstpointer b)
-{
-  if (a < b)
-    return -1;
-  else if (a > b)
-    return 1;
-  else
-    return 0;
-}
-
 /**
  * meta_display_list_windows:
  * @display: a #MetaDisplay
@@ -1006,79 +1002,121 @@ meta_display_list_windows (MetaDisplay          *display,
                            MetaListWindowsFlags  flags)
 {
   GSList *winlist;
-  GSList *prev;
-  GSList *tmp;
-  GHashTableIter iter;
-  gpointer key, value;
+  guint i;
 
   winlist = NULL;
 
-  g_hash_table_iter_init (&iter, display->xids);
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  /* The index only holds managed windows, each of them once, so unlike
+   * the xids table it needs neither filtering nor uniquifying.
+   */
+  for (i = 0; i < display->window_index->len; i++)
     {
-      MetaWindow *window = value;
-
-      if (!META_IS_WINDOW (window) || window->unmanaging)
-        continue;
+      MetaWindow *window = g_ptr_array_index (display->window_index, i);
 
       if (!window->override_redirect ||
           (flags & META_LIST_INCLUDE_OVERRIDE_REDIRECT) != 0)
         winlist = g_slist_prepend (winlist, window);
     }
 
-  g_hash_table_iter_init (&iter, display->wayland_windows);
-  while (g_hash_table_iter_next (&iter, &key, &value))
-    {
-      MetaWindow *window = value;
+  if (flags & META_LIST_SORTED)
+    winlist = g_slist_sort (winlist, mru_cmp);
 
-      if (!META_IS_WINDOW (window) || window->unmanaging)
-        continue;
+  return winlist;
+}
 
-      if (!window->override_redirect ||
-          (flags & META_LIST_INCLUDE_OVERRIDE_REDIRECT) != 0)
-        winlist = g_slist_prepend (winlist, window);
-    }
+void
+meta_display_add_window_to_index (MetaDisplay *display,
+                                  MetaWindow  *window)
+{
+  g_return_if_fail (window->display_index < 0);
 
-  /* Uniquify the list, since both frame windows and plain
-   * windows are in the hash
-   */
-  winlist = g_slist_sort (winlist, ptrcmp);
+  window->display_index = display->window_index->len;
+  g_ptr_array_add (display->window_index, window);
+  display->window_index_serial++;
+}
 
-  prev = NULL;
-  tmp = winlist;
-  while (tmp != NULL)
+void
+meta_display_remove_window_from_index (MetaDisplay *display,
+                                       MetaWindow  *window)
+{
+  int index = window->display_index;
+
+  if (index < 0)
+    return;
+
+  g_ptr_array_remove_index_fast (display->window_index, index);
+  if ((guint) index < display->window_index->len)
     {
-      GSList *next;
+      MetaWindow *moved = g_ptr_array_index (display->window_index, index);
+      moved->display_index = index;
+    }
 
-      next = tmp->next;
+  window->display_index = -1;
+  window->stacked_index = -1;
+  display->window_index_serial++;
+}
 
-      if (next &&
-          next->data == tmp->data)
-        {
-          /* Delete tmp from list */
+/**
+ * meta_display_get_stacked_windows:
+ * @display: a #MetaDisplay
+ *
+ * Gets every managed window, override-redirect ones included, ordered
+ * from bottom to top. The array is owned by @display and is only rebuilt
+ * when windows were managed or unmanaged or the stack changed since the
+ * previous call, so iterating it doesn't allocate; it must not be
+ * modified, nor kept across calls that may change the stack.
+ *
+ * Windows that are not in the stack, which are override-redirect windows
+ * and windows still being managed, are ordered above all others, as
+ * meta_stack_windows_cmp() would order them.
+ *
+ * Returns: (transfer none): the windows, bottom to top
+ */
+GPtrArray*
+meta_display_get_stacked_windows (MetaDisplay *display)
+{
+  MetaStack *stack = display->screen->stack;
+  guint64 stack_serial;
+  GList *l;
+  guint i;
+
+  stack_serial = meta_stack_get_serial (stack);
+  if (display->stacked_windows_index_serial == display->window_index_serial &&
+      display->stacked_windows_stack_serial == stack_serial)
+    return display->stacked_windows;
 
-          if (prev)
-            prev->next = next;
+  g_ptr_array_set_size (display->stacked_windows, 0);
 
-          if (tmp == winlist)
-            winlist = next;
+  for (l = g_list_last (stack->sorted); l; l = l->prev)
+    {
+      MetaWindow *window = l->data;
 
-          g_slist_free_1 (tmp);
+      if (window->display_index < 0)
+        continue;
 
-          /* leave prev unchanged */
-        }
-      else
-        {
-          prev = tmp;
-        }
+      window->stacked_index = display->stacked_windows->len;
+      g_ptr_array_add (display->stacked_windows, window);
+    }
 
-      tmp = next;
+  for (i = 0; i < display->window_index->len; i++)
+    {
+      MetaWindow *window = g_ptr_array_index (display->window_index, i);
+
+      if (window->stack_position >= 0)
+        continue;
+
+      window->stacked_index = display->stacked_windows->len;
+      g_ptr_array_add (display->stacked_windows, window);
     }
 
-  if (flags & META_LIST_SORTED)
-    winlist = g_slist_sort (winlist, mru_cmp);
+  display->stacked_windows_index_serial = display->window_index_serial;
+  display->stacked_windows_stack_serial = stack_serial;
 
-  return winlist;
+  meta_topic (META_DEBUG_STACK,
+              "Rebuilt stacked window index of %u windows\n",
+              display->stacked_windows->len);
+
+  return display->stacked_windows;
 }
 
 void
@@ -1125,6 +1163,8 @@ meta_display_close (MetaDisplay *display,
    */
   g_hash_table_destroy (display->xids);
   g_hash_table_destroy (display->wayland_windows);
+  g_ptr_array_free (display->window_index, TRUE);
+  g_ptr_array_free (display->stacked_windows, TRUE);
 
   if (display->leader_window != None)
     XDestroyWindow (display->xdisplay, display->leader_window);
@@ -1141,6 +1181,9 @@ meta_display_close (MetaDisplay *display,
   if (display->compositor)
     meta_compositor_destroy (display->compositor);
 
+  /* After everything that may still push an error trap */
+  g_clear_pointer (&display->error_trap_serials, g_array_unref);
+
   g_object_unref (display);
   the_display = NULL;
 
@@ -1316,10 +1359,11 @@ meta_display_get_current_time_roundtrip (MetaDisplay *display)
       XChangeProperty (display->xdisplay, display->timestamp_pinging_window,
                        display->atom__MUTTER_TIMESTAMP_PING,
                        XA_STRING, 8, PropModeAppend, NULL, 0);
-      XIfEvent (display->xdisplay,
-                &property_event,
-                find_timestamp_predicate,
-                (XPointer) display);
+      META_X_ROUNDTRIP ("_MUTTER_TIMESTAMP_PING",
+                        XIfEvent (display->xdisplay,
+                                  &property_event,
+                                  find_timestamp_predicate,
+                                  (XPointer) display));
       timestamp = property_event.xproperty.time;
     }
 
@@ -1882,7 +1926,7 @@ meta_display_begin_grab_op (MetaDisplay *display,
   XIUngrabDevice (display->xdisplay,
                   META_VIRTUAL_CORE_POINTER_ID,
                   timestamp);
-  XSync (display->xdisplay, False);
+  META_X_ROUNDTRIP ("XSync", XSync (display->xdisplay, False));
 
   if (meta_backend_grab_device (backend, META_VIRTUAL_CORE_POINTER_ID, timestamp))
     display->grab_have_pointer = TRUE;
@@ -1917,17 +1961,15 @@ meta_display_begin_grab_op (MetaDisplay *display,
   display->grab_anchor_root_y = root_y;
   display->grab_latest_motion_x = root_x;
   display->grab_latest_motion_y = root_y;
-  display->grab_last_moveresize_time.tv_sec = 0;
-  display->grab_last_moveresize_time.tv_usec = 0;
   display->grab_last_user_action_was_snap = FALSE;
   display->grab_frame_action = frame_action;
 
   meta_display_update_cursor (display);
 
-  if (display->grab_resize_timeout_id)
+  if (display->grab_motion_later)
     {
-      g_source_remove (display->grab_resize_timeout_id);
-      display->grab_resize_timeout_id = 0;
+      meta_later_remove (display->grab_motion_later);
+      display->grab_motion_later = 0;
     }
 
   meta_topic (META_DEBUG_WINDOW_OPS,
@@ -1979,8 +2021,9 @@ meta_display_end_grab_op (MetaDisplay *display,
 
   if (display->event_route == META_EVENT_ROUTE_WINDOW_OP)
     {
-      /* Clear out the edge cache */
+      /* Clear out the edge and constraint caches */
       meta_display_cleanup_edges (display);
+      meta_display_cleanup_constraint_cache (display);
 
       /* Only raise the window in orthogonal raise
        * ('do-not-raise-on-click') mode if the user didn't try to move
@@ -2015,10 +2058,10 @@ meta_display_end_grab_op (MetaDisplay *display,
 
   meta_display_update_cursor (display);
 
-  if (display->grab_resize_timeout_id)
+  if (display->grab_motion_later)
     {
-      g_source_remove (display->grab_resize_timeout_id);
-      display->grab_resize_timeout_id = 0;
+      meta_later_remove (display->grab_motion_later);
+      display->grab_motion_later = 0;
     }
 
   if (meta_is_wayland_compositor ())
@@ -2128,6 +2171,32 @@ update_cursor_theme (void)
     MetaDisplay *display = meta_get_display ();
     set_cursor_theme (display->xdisplay);
 
+    /* Cursor atlases are only built, and dropped on theme changes,
+     * when they are preloaded here, i.e. as a Wayland compositor. On
+     * startup the screen doesn't exist yet; other scales are then
+     * built on first use. */
+    if (meta_is_wayland_compositor ())
+      {
+        MetaScreen *screen = display->screen;
+        int n_monitor_infos = screen ? screen->n_monitor_infos : 0;
+        int *scales = g_newa (int, n_monitor_infos + 1);
+        int n_scales = 0;
+        int i, j;
+
+        scales[n_scales++] = 1;
+        for (i = 0; i < n_monitor_infos; i++)
+          {
+            for (j = 0; j < n_scales; j++)
+              if (scales[j] == screen->monitor_infos[i].scale)
+                break;
+
+            if (j == n_scales)
+              scales[n_scales++] = screen->monitor_infos[i].scale;
+          }
+
+        meta_cursor_sprite_preload_theme (scales, n_scales);
+      }
+
     if (display->screen)
       meta_screen_update_cursor (display->screen);
   }
@@ -2428,6 +2497,70 @@ mru_cmp (gconstpointer a,
     return 0;
 }
 
+/**
+ * meta_display_update_window_mru:
+ * @display: a #MetaDisplay
+ * @window: a managed, non-override-redirect #MetaWindow
+ *
+ * Inserts @window into the global MRU list, or moves it to its new
+ * position after its user time changed. User times almost always move
+ * forward, so the search for the new position is short.
+ */
+void
+meta_display_update_window_mru (MetaDisplay *display,
+                                MetaWindow  *window)
+{
+  GList *link;
+  GList *tmp;
+
+  g_return_if_fail (!window->override_redirect);
+
+  if (window->unmanaging)
+    return;
+
+  link = window->display_mru_link;
+  if (link != NULL)
+    display->mru_list = g_list_remove_link (display->mru_list, link);
+  else
+    link = g_list_alloc ();
+
+  link->data = window;
+  window->display_mru_link = link;
+
+  for (tmp = display->mru_list; tmp; tmp = tmp->next)
+    {
+      if (mru_cmp (window, tmp->data) <= 0)
+        break;
+    }
+
+  if (tmp == NULL)
+    {
+      display->mru_list = g_list_concat (display->mru_list, link);
+    }
+  else
+    {
+      link->prev = tmp->prev;
+      link->next = tmp;
+      if (tmp->prev)
+        tmp->prev->next = link;
+      else
+        display->mru_list = link;
+      tmp->prev = link;
+    }
+}
+
+void
+meta_display_remove_window_mru (MetaDisplay *display,
+                                MetaWindow  *window)
+{
+  if (window->display_mru_link == NULL)
+    return;
+
+  display->mru_list = g_list_delete_link (display->mru_list,
+                                          window->display_mru_link);
+  window->display_mru_link = NULL;
+}
+
 /**
  * meta_display_get_tab_list:
  * @display: a #MetaDisplay
@@ -2448,20 +2581,13 @@ meta_display_get_tab_list (MetaDisplay   *display,
                            MetaWorkspace *workspace)
 {
   GList *tab_list = NULL;
-  GList *global_mru_list = NULL;
   GList *mru_list, *tmp;
-  GSList *windows = meta_display_list_windows (display, META_LIST_DEFAULT);
-  GSList *w;
 
-  if (workspace == NULL)
-    {
-      /* Yay for mixing GList and GSList in the API */
-      for (w = windows; w; w = w->next)
-        global_mru_list = g_list_prepend (global_mru_list, w->data);
-      global_mru_list = g_list_sort (global_mru_list, mru_cmp);
-    }
-
-  mru_list = workspace ? workspace->mru_list : global_mru_list;
+  /* The global MRU list is kept sorted as user times change, and it
+   * contains exactly the windows meta_display_list_windows() returns
+   * for META_LIST_DEFAULT, so there is nothing to list or sort here.
+   */
+  mru_list = workspace ? workspace->mru_list : display->mru_list;
 
   /* Windows sellout mode - MRU order. Collect unminimized windows
    * then minimized so minimized windows aren't in the way so much.
@@ -2488,9 +2614,9 @@ meta_display_get_tab_list (MetaDisplay   *display,
    * other workspaces that demand attention
    */
   if (workspace)
-    for (w = windows; w; w = w->next)
+    for (tmp = display->mru_list; tmp; tmp = tmp->next)
       {
-        MetaWindow *l_window = w->data;
+        MetaWindow *l_window = tmp->data;
 
         if (l_window->wm_state_demands_attention &&
             l_window->workspace != workspace &&
@@ -2498,9 +2624,6 @@ meta_display_get_tab_list (MetaDisplay   *display,
           tab_list = g_list_prepend (tab_list, l_window);
       }
 
-  g_list_free (global_mru_list);
-  g_slist_free (windows);
-
   return tab_list;
 }
 
@@ -2708,11 +2831,44 @@ GSList *
 meta_display_sort_windows_by_stacking (MetaDisplay *display,
                                        GSList      *windows)
 {
-  GSList *copy = g_slist_copy (windows);
+  GPtrArray *stacked;
+  MetaWindow **slots;
+  GSList *sorted = NULL;
+  GSList *l;
+  int i;
+
+  stacked = meta_display_get_stacked_windows (display);
+
+  /* Every managed window knows its place in the stacked index, so the
+   * windows can be dropped into their slots instead of being compared.
+   * Windows that aren't in the index (unmanaging ones, or duplicates)
+   * take the slower path.
+   */
+  slots = g_new0 (MetaWindow *, stacked->len);
+  for (l = windows; l; l = l->next)
+    {
+      MetaWindow *window = l->data;
+      int index = window->stacked_index;
+
+      if (window->display_index < 0 || index < 0 ||
+          (guint) index >= stacked->len || slots[index] != NULL)
+        {
+          g_free (slots);
+          return g_slist_sort (g_slist_copy (windows), meta_display_stack_cmp);
+        }
+
+      slots[index] = window;
+    }
+
+  for (i = stacked->len - 1; i >= 0; i--)
+    {
+      if (slots[i] != NULL)
+        sorted = g_slist_prepend (sorted, slots[i]);
+    }
 
-  copy = g_slist_sort (copy, meta_display_stack_cmp);
+  g_free (slots);
 
-  return copy;
+  return sorted;
 }
 
 static void
@@ -58,9 +58,16 @@ struct MetaEdgeResistanceData
   ResistanceDataForAnEdge right_data;
   ResistanceDataForAnEdge top_data;
   ResistanceDataForAnEdge bottom_data;
+
+  /* Set when the workspace's monitor and screen edges were dropped from
+   * the arrays above because its work area changed; they get merged back
+   * in lazily, without recomputing the window edges.
+   */
+  gboolean workspace_edges_stale;
 };
 
 static void compute_resistance_and_snapping_edges (MetaDisplay *display);
+static void refresh_workspace_edges               (MetaDisplay *display);
 
 /* !WARNING!: this function can return invalid indices (namely, either -1 or
  * edges->len); this is by design, but you need to remember this.
@@ -553,6 +560,8 @@ apply_edge_resistance_to_each_side (MetaDisplay         *display,
 
   if (display->grab_edge_resistance_data == NULL)
     compute_resistance_and_snapping_edges (display);
+  else if (display->grab_edge_resistance_data->workspace_edges_stale)
+    refresh_workspace_edges (display);
 
   edge_data = display->grab_edge_resistance_data;
 
@@ -762,6 +771,100 @@ stupid_sort_requiring_extra_pointer_dereference (gconstpointer a,
   return meta_rectangle_edge_cmp_ignore_type (*a_edge, *b_edge);
 }
 
+static void
+add_edge_to_arrays (MetaEdgeResistanceData *edge_data,
+                    MetaEdge               *edge)
+{
+  switch (edge->side_type)
+    {
+    case META_SIDE_LEFT:
+    case META_SIDE_RIGHT:
+      g_array_append_val (edge_data->left_edges, edge);
+      g_array_append_val (edge_data->right_edges, edge);
+      break;
+    case META_SIDE_TOP:
+    case META_SIDE_BOTTOM:
+      g_array_append_val (edge_data->top_edges, edge);
+      g_array_append_val (edge_data->bottom_edges, edge);
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+/* Drops everything but window edges from a sorted edge array, keeping the
+ * remaining edges in order.
+ */
+static void
+remove_workspace_edges (GArray *edges)
+{
+  guint i, kept;
+
+  kept = 0;
+  for (i = 0; i < edges->len; i++)
+    {
+      MetaEdge *edge = g_array_index (edges, MetaEdge*, i);
+      if (edge->edge_type == META_EDGE_WINDOW)
+        g_array_index (edges, MetaEdge*, kept++) = edge;
+    }
+  g_array_set_size (edges, kept);
+}
+
+/**
+ * meta_display_invalidate_workspace_edges:
+ * @display: a #MetaDisplay
+ *
+ * Called when the work area of the active workspace is about to change
+ * during a grab.  The cached pointers to the workspace's monitor and screen
+ * edges are dropped, but the window edges are kept; the new workspace edges
+ * are merged back in the next time edge resistance is applied.
+ */
+void
+meta_display_invalidate_workspace_edges (MetaDisplay *display)
+{
+  MetaEdgeResistanceData *edge_data = display->grab_edge_resistance_data;
+
+  if (edge_data == NULL || edge_data->workspace_edges_stale)
+    return;
+
+  remove_workspace_edges (edge_data->left_edges);
+  remove_workspace_edges (edge_data->right_edges);
+  remove_workspace_edges (edge_data->top_edges);
+  remove_workspace_edges (edge_data->bottom_edges);
+
+  edge_data->workspace_edges_stale = TRUE;
+}
+
+static void
+refresh_workspace_edges (MetaDisplay *display)
+{
+  MetaEdgeResistanceData *edge_data = display->grab_edge_resistance_data;
+  MetaWorkspace *workspace = display->screen->active_workspace;
+  GList *tmp;
+
+  /* Make sure the workspace has recomputed its edges */
+  meta_workspace_get_onscreen_region (workspace);
+
+  for (tmp = workspace->monitor_edges; tmp; tmp = tmp->next)
+    add_edge_to_arrays (edge_data, tmp->data);
+  for (tmp = workspace->screen_edges; tmp; tmp = tmp->next)
+    add_edge_to_arrays (edge_data, tmp->data);
+
+  g_array_sort (edge_data->left_edges,
+                stupid_sort_requiring_extra_pointer_dereference);
+  g_array_sort (edge_data->right_edges,
+                stupid_sort_requiring_extra_pointer_dereference);
+  g_array_sort (edge_data->top_edges,
+                stupid_sort_requiring_extra_pointer_dereference);
+  g_array_sort (edge_data->bottom_edges,
+                stupid_sort_requiring_extra_pointer_dereference);
+
+  edge_data->workspace_edges_stale = FALSE;
+
+  meta_topic (META_DEBUG_EDGE_RESISTANCE,
+              "Merged updated workspace edges into the grab edge cache\n");
+}
+
 static void
 cache_edges (MetaDisplay *display,
              GList *window_edges,
@@ -890,22 +993,7 @@ cache_edges (MetaDisplay *display,
 
       while (tmp)
         {
-          MetaEdge *edge = tmp->data;
-          switch (edge->side_type)
-            {
-            case META_SIDE_LEFT:
-            case META_SIDE_RIGHT:
-              g_array_append_val (edge_data->left_edges, edge);
-              g_array_append_val (edge_data->right_edges, edge);
-              break;
-            case META_SIDE_TOP:
-            case META_SIDE_BOTTOM:
-              g_array_append_val (edge_data->top_edges, edge);
-              g_array_append_val (edge_data->bottom_edges, edge);
-              break;
-            default:
-              g_assert_not_reached ();
-            }
+          add_edge_to_arrays (edge_data, tmp->data);
           tmp = tmp->next;
         }
     }
@@ -942,19 +1030,163 @@ initialize_grab_edge_resistance_data (MetaDisplay *display)
   edge_data->bottom_data.keyboard_buildup = 0;
 }
 
+/* A window rectangle or window edge, together with the window's position in
+ * the stack and its extent along the axis we are sweeping over.
+ */
+typedef struct
+{
+  const MetaRectangle *rect;
+  int                  stack_position;
+  int                  sweep_start;
+  int                  sweep_end;
+} SweepBox;
+
+typedef struct
+{
+  MetaEdge *edge;
+  int       stack_position;
+  int       sweep_pos;
+} SweepEdge;
+
+static int
+compare_sweep_boxes (gconstpointer a,
+                     gconstpointer b)
+{
+  const SweepBox *a_box = a;
+  const SweepBox *b_box = b;
+
+  return a_box->sweep_start - b_box->sweep_start;
+}
+
+static int
+compare_sweep_edges (gconstpointer a,
+                     gconstpointer b)
+{
+  const SweepEdge *a_edge = a;
+  const SweepEdge *b_edge = b;
+
+  return a_edge->sweep_pos - b_edge->sweep_pos;
+}
+
+/* Removes the portions of the given edges which are obscured by boxes
+ * higher in the stack, returning the surviving pieces.  All edges must be
+ * vertical (if vertical is TRUE) or all horizontal.
+ *
+ * Rather than testing every edge against every box, we sweep a line across
+ * the screen perpendicular to the edges, keeping the set of boxes the line
+ * currently crosses; each edge then only needs to be checked against the
+ * boxes in that active set.
+ */
+static GList *
+remove_obscured_edge_portions (GArray   *sweep_edges,
+                               GArray   *boxes,
+                               gboolean  vertical)
+{
+  GList *result;
+  GList *active;
+  guint next_box, i;
+
+  for (i = 0; i < boxes->len; i++)
+    {
+      SweepBox *box = &g_array_index (boxes, SweepBox, i);
+
+      box->sweep_start = vertical ? BOX_LEFT (*box->rect)  : BOX_TOP (*box->rect);
+      box->sweep_end   = vertical ? BOX_RIGHT (*box->rect) : BOX_BOTTOM (*box->rect);
+    }
+  g_array_sort (boxes, compare_sweep_boxes);
+
+  for (i = 0; i < sweep_edges->len; i++)
+    {
+      SweepEdge *sweep_edge = &g_array_index (sweep_edges, SweepEdge, i);
+
+      sweep_edge->sweep_pos = vertical ? sweep_edge->edge->rect.x
+                                       : sweep_edge->edge->rect.y;
+    }
+  g_array_sort (sweep_edges, compare_sweep_edges);
+
+  result = NULL;
+  active = NULL;
+  next_box = 0;
+  for (i = 0; i < sweep_edges->len; i++)
+    {
+      SweepEdge *sweep_edge = &g_array_index (sweep_edges, SweepEdge, i);
+      GSList *obscuring;
+      GList *pieces, *link;
+
+      /* Boxes join the active set once the sweep line reaches their near
+       * side...
+       */
+      while (next_box < boxes->len &&
+             g_array_index (boxes, SweepBox, next_box).sweep_start <=
+             sweep_edge->sweep_pos)
+        {
+          active = g_list_prepend (active,
+                                   &g_array_index (boxes, SweepBox, next_box));
+          next_box++;
+        }
+
+      /* ...and leave it once the line is past their far side.  Of the ones
+       * left, only those stacked above the edge's window can obscure it.
+       */
+      obscuring = NULL;
+      link = active;
+      while (link)
+        {
+          SweepBox *box = link->data;
+          GList *next = link->next;
+
+          if (box->sweep_end < sweep_edge->sweep_pos)
+            active = g_list_delete_link (active, link);
+          else if (box->stack_position > sweep_edge->stack_position)
+            obscuring = g_slist_prepend (obscuring, (gpointer) box->rect);
+
+          link = next;
+        }
+
+      pieces = g_list_prepend (NULL, sweep_edge->edge);
+      pieces =
+        meta_rectangle_remove_intersections_with_boxes_from_edges (pieces,
+                                                                   obscuring);
+      result = g_list_concat (pieces, result);
+
+      g_slist_free (obscuring);
+    }
+
+  g_list_free (active);
+
+  return result;
+}
+
+static void
+add_sweep_edge (GArray        *sweep_edges,
+                MetaRectangle  rect,
+                MetaSide       side_type,
+                int            stack_position)
+{
+  SweepEdge sweep_edge;
+
+  sweep_edge.edge = g_new (MetaEdge, 1);
+  sweep_edge.edge->rect = rect;
+  sweep_edge.edge->side_type = side_type;
+  sweep_edge.edge->edge_type = META_EDGE_WINDOW;
+  sweep_edge.stack_position = stack_position;
+  sweep_edge.sweep_pos = 0;
+
+  g_array_append_val (sweep_edges, sweep_edge);
+}
+
 static void
 compute_resistance_and_snapping_edges (MetaDisplay *display)
 {
   GList *stacked_windows;
   GList *cur_window_iter;
   GList *edges;
-  /* Lists of window positions (rects) and their relative stacking positions */
   int stack_position;
-  GSList *obscuring_windows, *window_stacking;
-  /* The portions of the above lists that still remain at the stacking position
-   * in the layer that we are working on
-   */
-  GSList *rem_windows, *rem_win_stacking;
+  MetaRectangle *window_rects;
+  GArray *boxes, *vertical_edges, *horizontal_edges;
+#ifdef WITH_VERBOSE_MODE
+  gint64 start_time = g_get_monotonic_time ();
+#endif
 
   g_assert (display->grab_window != NULL);
   meta_topic (META_DEBUG_WINDOW_OPS,
@@ -969,148 +1201,105 @@ compute_resistance_and_snapping_edges (MetaDisplay *display)
                              display->screen->active_workspace);
 
   /*
-   * 2nd: we need to separate that stacked list into a list of windows that
-   * can obscure other edges.  To make sure we only have windows obscuring
-   * those below it instead of going both ways, we also need to keep a
-   * counter list.  Messy, I know.
+   * 2nd: Record the windows that can obscure other edges, along with
+   * their stacking position so that windows only obscure those below them
+   * instead of going both ways.  At the same time, create the edges of
+   * the (non-dock) windows; dock edges are considered screen edges which
+   * are handled separately.
    */
-  obscuring_windows = window_stacking = NULL;
-  cur_window_iter = stacked_windows;
-  stack_position = 0;
-  while (cur_window_iter != NULL)
-    {
-      MetaWindow *cur_window = cur_window_iter->data;
-      if (WINDOW_EDGES_RELEVANT (cur_window, display))
-        {
-          MetaRectangle *new_rect;
-          new_rect = g_new (MetaRectangle, 1);
-          meta_window_get_frame_rect (cur_window, new_rect);
-          obscuring_windows = g_slist_prepend (obscuring_windows, new_rect);
-          window_stacking =
-            g_slist_prepend (window_stacking, GINT_TO_POINTER (stack_position));
-        }
+  window_rects = g_new (MetaRectangle, g_list_length (stacked_windows));
+  boxes = g_array_new (FALSE, FALSE, sizeof (SweepBox));
+  vertical_edges = g_array_new (FALSE, FALSE, sizeof (SweepEdge));
+  horizontal_edges = g_array_new (FALSE, FALSE, sizeof (SweepEdge));
 
-      stack_position++;
-      cur_window_iter = cur_window_iter->next;
-    }
-  /* Put 'em in bottom to top order */
-  rem_windows = obscuring_windows = g_slist_reverse (obscuring_windows);
-  rem_win_stacking = window_stacking = g_slist_reverse (window_stacking);
-
-  /*
-   * 3rd: loop over the windows again, this time getting the edges from
-   * them and removing intersections with the relevant obscuring_windows &
-   * obscuring_docks.
-   */
-  edges = NULL;
   stack_position = 0;
   cur_window_iter = stacked_windows;
   while (cur_window_iter != NULL)
     {
-      MetaRectangle  cur_rect;
-      MetaWindow    *cur_window = cur_window_iter->data;
-      meta_window_get_frame_rect (cur_window, &cur_rect);
+      MetaWindow *cur_window = cur_window_iter->data;
 
-      /* Check if we want to use this window's edges for edge
-       * resistance (note that dock edges are considered screen edges
-       * which are handled separately
-       */
-      if (WINDOW_EDGES_RELEVANT (cur_window, display) &&
-          cur_window->type != META_WINDOW_DOCK)
+      if (WINDOW_EDGES_RELEVANT (cur_window, display))
         {
-          GList *new_edges;
-          MetaEdge *new_edge;
-          MetaRectangle reduced;
+          MetaRectangle *cur_rect = &window_rects[boxes->len];
+          SweepBox box;
 
-          /* We don't care about snapping to any portion of the window that
-           * is offscreen (we also don't care about parts of edges covered
-           * by other windows or DOCKS, but that's handled below).
-           */
-          meta_rectangle_intersect (&cur_rect,
-                                    &display->screen->rect,
-                                    &reduced);
+          meta_window_get_frame_rect (cur_window, cur_rect);
 
-          new_edges = NULL;
+          box.rect = cur_rect;
+          box.stack_position = stack_position;
+          box.sweep_start = box.sweep_end = 0;
+          g_array_append_val (boxes, box);
 
-          /* Left side of this window is resistance for the right edge of
-           * the window being moved.
-           */
-          new_edge = g_new (MetaEdge, 1);
-          new_edge->rect = reduced;
-          new_edge->rect.width = 0;
-          new_edge->side_type = META_SIDE_RIGHT;
-          new_edge->edge_type = META_EDGE_WINDOW;
-          new_edges = g_list_prepend (new_edges, new_edge);
-
-          /* Right side of this window is resistance for the left edge of
-           * the window being moved.
-           */
-          new_edge = g_new (MetaEdge, 1);
-          new_edge->rect = reduced;
-          new_edge->rect.x += new_edge->rect.width;
-          new_edge->rect.width = 0;
-          new_edge->side_type = META_SIDE_LEFT;
-          new_edge->edge_type = META_EDGE_WINDOW;
-          new_edges = g_list_prepend (new_edges, new_edge);
-
-          /* Top side of this window is resistance for the bottom edge of
-           * the window being moved.
-           */
-          new_edge = g_new (MetaEdge, 1);
-          new_edge->rect = reduced;
-          new_edge->rect.height = 0;
-          new_edge->side_type = META_SIDE_BOTTOM;
-          new_edge->edge_type = META_EDGE_WINDOW;
-          new_edges = g_list_prepend (new_edges, new_edge);
-
-          /* Top side of this window is resistance for the bottom edge of
-           * the window being moved.
-           */
-          new_edge = g_new (MetaEdge, 1);
-          new_edge->rect = reduced;
-          new_edge->rect.y += new_edge->rect.height;
-          new_edge->rect.height = 0;
-          new_edge->side_type = META_SIDE_TOP;
-          new_edge->edge_type = META_EDGE_WINDOW;
-          new_edges = g_list_prepend (new_edges, new_edge);
-
-          /* Update the remaining windows to only those at a higher
-           * stacking position than this one.
-           */
-          while (rem_win_stacking &&
-                 stack_position >= GPOINTER_TO_INT (rem_win_stacking->data))
+          if (cur_window->type != META_WINDOW_DOCK)
             {
-              rem_windows      = rem_windows->next;
-              rem_win_stacking = rem_win_stacking->next;
-            }
+              MetaRectangle reduced, edge_rect;
+
+              /* We don't care about snapping to any portion of the window
+               * that is offscreen (we also don't care about parts of edges
+               * covered by other windows or DOCKS, but that's handled
+               * below).
+               */
+              meta_rectangle_intersect (cur_rect,
+                                        &display->screen->rect,
+                                        &reduced);
+
+              /* Left side of this window is resistance for the right edge
+               * of the window being moved.
+               */
+              edge_rect = reduced;
+              edge_rect.width = 0;
+              add_sweep_edge (vertical_edges, edge_rect,
+                              META_SIDE_RIGHT, stack_position);
 
-          /* Remove edge portions overlapped by rem_windows and rem_docks */
-          new_edges =
-            meta_rectangle_remove_intersections_with_boxes_from_edges (
-              new_edges,
-              rem_windows);
+              /* Right side of this window is resistance for the left edge
+               * of the window being moved.
+               */
+              edge_rect = reduced;
+              edge_rect.x += edge_rect.width;
+              edge_rect.width = 0;
+              add_sweep_edge (vertical_edges, edge_rect,
+                              META_SIDE_LEFT, stack_position);
+
+              /* Top side of this window is resistance for the bottom edge
+               * of the window being moved.
+               */
+              edge_rect = reduced;
+              edge_rect.height = 0;
+              add_sweep_edge (horizontal_edges, edge_rect,
+                              META_SIDE_BOTTOM, stack_position);
 
-          /* Save the new edges */
-          edges = g_list_concat (new_edges, edges);
+              /* Bottom side of this window is resistance for the top edge
+               * of the window being moved.
+               */
+              edge_rect = reduced;
+              edge_rect.y += edge_rect.height;
+              edge_rect.height = 0;
+              add_sweep_edge (horizontal_edges, edge_rect,
+                              META_SIDE_TOP, stack_position);
+            }
         }
 
       stack_position++;
       cur_window_iter = cur_window_iter->next;
     }
 
+  /*
+   * 3rd: Remove the edge portions overlapped by windows higher in the
+   * stack, sweeping over each axis in turn.
+   */
+  edges = remove_obscured_edge_portions (vertical_edges, boxes, TRUE);
+  edges = g_list_concat (remove_obscured_edge_portions (horizontal_edges,
+                                                        boxes, FALSE),
+                         edges);
+
   /*
    * 4th: Free the extra memory not needed and sort the list
    */
   g_list_free (stacked_windows);
-  /* Free the memory used by the obscuring windows/docks lists */
-  g_slist_free (window_stacking);
-  /* FIXME: Shouldn't there be a helper function to make this one line of code
-   * to free a list instead of four ugly ones?
-   */
-  g_slist_foreach (obscuring_windows,
-                   (void (*)(gpointer,gpointer))&g_free, /* ew, for ugly */
-                   NULL);
-  g_slist_free (obscuring_windows);
+  g_array_free (vertical_edges, TRUE);
+  g_array_free (horizontal_edges, TRUE);
+  g_array_free (boxes, TRUE);
+  g_free (window_rects);
 
   /* Sort the list.  FIXME: Should I bother with this sorting?  I just
    * sort again later in cache_edges() anyway...
@@ -1132,6 +1321,12 @@ compute_resistance_and_snapping_edges (MetaDisplay *display)
    * 6th: Initialize the resistance timeouts and buildups
    */
   initialize_grab_edge_resistance_data (display);
+
+#ifdef WITH_VERBOSE_MODE
+  meta_topic (META_DEBUG_EDGE_RESISTANCE,
+              "Computed edges for %d windows in %" G_GINT64_FORMAT " us\n",
+              stack_position, g_get_monotonic_time () - start_time);
+#endif
 }
 
 void
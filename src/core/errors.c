@@ -27,6 +27,7 @@
 #include <config.h>
 #include <meta/errors.h>
 #include "display-private.h"
+#include "x11/roundtrip-audit.h"
 #include <errno.h>
 #include <stdlib.h>
 #include <gdk/gdk.h>
@@ -43,20 +44,84 @@
  * (See https://bugzilla.gnome.org/show_bug.cgi?id=630216 for restoring logging.)
  */
 
+/* On top of GDK's traps, we remember the request serial at which each
+ * trap started. gdk_error_trap_pop_ignored() never blocks; errors that
+ * arrive later for the trapped serial range are just dropped. Only
+ * meta_error_trap_pop_with_return() may need a round trip, and it can
+ * skip even that when no request was issued inside the trap.
+ */
+
 void
 meta_error_trap_push (MetaDisplay *display)
 {
+  gulong serial;
+
   gdk_error_trap_push ();
+
+  if (display->error_trap_serials == NULL)
+    display->error_trap_serials = g_array_new (FALSE, FALSE, sizeof (gulong));
+
+  serial = NextRequest (display->xdisplay);
+  g_array_append_val (display->error_trap_serials, serial);
+}
+
+static gulong
+pop_trap_serial (MetaDisplay *display)
+{
+  GArray *serials = display->error_trap_serials;
+  gulong serial;
+
+  g_return_val_if_fail (serials != NULL && serials->len > 0, 0);
+
+  serial = g_array_index (serials, gulong, serials->len - 1);
+  g_array_set_size (serials, serials->len - 1);
+
+  return serial;
 }
 
 void
 meta_error_trap_pop (MetaDisplay *display)
 {
+  pop_trap_serial (display);
   gdk_error_trap_pop_ignored ();
 }
 
 int
 meta_error_trap_pop_with_return  (MetaDisplay *display)
 {
+  gulong start_serial, next_serial;
+
+  start_serial = pop_trap_serial (display);
+  next_serial = NextRequest (display->xdisplay);
+
+  if (next_serial == start_serial)
+    {
+      /* Nothing was sent inside the trap, so nothing can have failed */
+      display->n_error_trap_syncs_avoided++;
+      gdk_error_trap_pop_ignored ();
+      return Success;
+    }
+
+  if (LastKnownRequestProcessed (display->xdisplay) >= next_serial - 1)
+    {
+      /* A reply already covered the trap, e.g. for a Get* request; any
+       * error has been received and GDK won't need to sync.
+       */
+      display->n_error_trap_syncs_avoided++;
+    }
+  else
+    {
+      int result;
+
+      display->n_error_trap_syncs++;
+      meta_topic (META_DEBUG_ERRORS,
+                  "Syncing for an error trap (%u syncs, %u avoided)\n",
+                  display->n_error_trap_syncs,
+                  display->n_error_trap_syncs_avoided);
+
+      META_X_ROUNDTRIP ("error trap sync", result = gdk_error_trap_pop ());
+      return result;
+    }
+
   return gdk_error_trap_pop ();
 }
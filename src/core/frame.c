@@ -27,6 +27,7 @@
 #include <meta/errors.h>
 #include "keybindings-private.h"
 #include "backends/x11/meta-backend-x11.h"
+#include "x11/roundtrip-audit.h"
 
 #define EVENT_MASK (SubstructureRedirectMask |                     \
                     StructureNotifyMask | SubstructureNotifyMask | \
@@ -126,7 +127,7 @@ meta_window_ensure_frame (MetaWindow *window)
         /* Since the backend selects for events on another connection,
          * make sure to sync the GTK+ connection to ensure that the
          * frame window has been created on the server at this point. */
-        XSync (window->display->xdisplay, False);
+        META_X_ROUNDTRIP ("XSync", XSync (window->display->xdisplay, False));
 
         unsigned char mask_bits[XIMaskLen (XI_LASTEVENT)] = { 0 };
         XIEventMask mask = { XIAllMasterDevices, sizeof (mask_bits), mask_bits };
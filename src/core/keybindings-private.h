@@ -103,6 +103,14 @@ typedef struct
   int n_iso_next_group_combos;
 
   xkb_level_index_t keymap_num_levels;
+  /* keysym -> GArray of keycodes, rebuilt on keymap changes */
+  GHashTable *keysym_keycodes;
+
+  /* Per-window grabs in place while the bindings are being rebuilt */
+  GArray *window_grab_set;
+  /* Passive grab and ungrab requests sent, for debugging */
+  guint n_grab_requests;
+  guint n_grab_requests_before_rebind;
 
   /* Alt+click button grabs */
   ClutterModifierType window_grab_modifiers;
@@ -39,6 +39,7 @@
 #include "screen-private.h"
 #include <meta/prefs.h>
 #include "meta-accel-parse.h"
+#include <string.h>
 
 #ifdef __linux__
 #include <linux/input.h>
@@ -134,6 +135,7 @@ static gboolean process_keyboard_resize_grab (MetaDisplay     *display,
 
 static void grab_key_bindings           (MetaDisplay *display);
 static void ungrab_key_bindings         (MetaDisplay *display);
+static void reload_keysym_index         (MetaKeyBindingManager *keys);
 
 static GHashTable *key_handlers;
 static GHashTable *external_grabs;
@@ -217,6 +219,8 @@ reload_modmap (MetaKeyBindingManager *keys)
 
   xkb_state_unref (scratch_state);
 
+  reload_keysym_index (keys);
+
   keys->ignored_modifier_mask = (scroll_lock_mask | Mod2Mask | LockMask);
 
   meta_topic (META_DEBUG_KEYBINDINGS,
@@ -228,49 +232,6 @@ reload_modmap (MetaKeyBindingManager *keys)
               keys->meta_mask);
 }
 
-static gboolean
-is_keycode_for_keysym (struct xkb_keymap *keymap,
-                       xkb_layout_index_t layout,
-                       xkb_level_index_t  level,
-                       xkb_keycode_t      keycode,
-                       xkb_keysym_t       keysym)
-{
-  const xkb_keysym_t *syms;
-  int num_syms, k;
-
-  num_syms = xkb_keymap_key_get_syms_by_level (keymap, keycode, layout, level, &syms);
-  for (k = 0; k < num_syms; k++)
-    {
-      if (syms[k] == keysym)
-        return TRUE;
-    }
-
-  return FALSE;
-}
-
-typedef struct
-{
-  GArray *keycodes;
-  xkb_keysym_t keysym;
-  xkb_layout_index_t layout;
-  xkb_level_index_t level;
-} FindKeysymData;
-
-static void
-get_keycodes_for_keysym_iter (struct xkb_keymap *keymap,
-                              xkb_keycode_t      keycode,
-                              void              *data)
-{
-  FindKeysymData *search_data = data;
-  GArray *keycodes = search_data->keycodes;
-  xkb_keysym_t keysym = search_data->keysym;
-  xkb_layout_index_t layout = search_data->layout;
-  xkb_level_index_t level = search_data->level;
-
-  if (is_keycode_for_keysym (keymap, layout, level, keycode, keysym))
-    g_array_append_val (keycodes, keycode);
-}
-
 /* Original code from gdk_x11_keymap_get_entries_for_keyval() in
  * gdkkeys-x11.c */
 static int
@@ -278,38 +239,28 @@ get_keycodes_for_keysym (MetaKeyBindingManager  *keys,
                          int                     keysym,
                          int                   **keycodes)
 {
-  GArray *retval;
-  int n_keycodes;
+  GArray *index_keycodes;
   int keycode;
 
-  retval = g_array_new (FALSE, FALSE, sizeof (int));
-
   /* Special-case: Fake mutter keysym */
   if (keysym == META_KEY_ABOVE_TAB)
     {
       keycode = KEY_GRAVE + 8;
-      g_array_append_val (retval, keycode);
-      goto out;
+      *keycodes = g_memdup (&keycode, sizeof (int));
+      return 1;
     }
 
-  {
-    MetaBackend *backend = meta_get_backend ();
-    struct xkb_keymap *keymap = meta_backend_get_keymap (backend);
-    xkb_layout_index_t i;
-    xkb_level_index_t j;
-
-    for (i = 0; i < xkb_keymap_num_layouts (keymap); i++)
-      for (j = 0; j < keys->keymap_num_levels; j++)
-        {
-          FindKeysymData search_data = { retval, keysym, i, j };
-          xkb_keymap_key_for_each (keymap, get_keycodes_for_keysym_iter, &search_data);
-        }
-  }
+  index_keycodes = g_hash_table_lookup (keys->keysym_keycodes,
+                                        GUINT_TO_POINTER (keysym));
+  if (index_keycodes == NULL)
+    {
+      *keycodes = NULL;
+      return 0;
+    }
 
- out:
-  n_keycodes = retval->len;
-  *keycodes = (int*) g_array_free (retval, n_keycodes == 0 ? TRUE : FALSE);
-  return n_keycodes;
+  *keycodes = g_memdup (index_keycodes->data,
+                        index_keycodes->len * sizeof (int));
+  return index_keycodes->len;
 }
 
 static guint
@@ -357,6 +308,79 @@ determine_keymap_num_levels (MetaKeyBindingManager *keys)
   xkb_keymap_key_for_each (keymap, determine_keymap_num_levels_iter, &keys->keymap_num_levels);
 }
 
+typedef struct
+{
+  GHashTable *keysym_keycodes;
+  xkb_layout_index_t layout;
+  xkb_level_index_t level;
+} IndexKeysymsData;
+
+static void
+index_keysyms_iter (struct xkb_keymap *keymap,
+                    xkb_keycode_t      keycode,
+                    void              *data)
+{
+  IndexKeysymsData *index_data = data;
+  const xkb_keysym_t *syms;
+  int num_syms, k;
+
+  num_syms = xkb_keymap_key_get_syms_by_level (keymap, keycode,
+                                               index_data->layout,
+                                               index_data->level,
+                                               &syms);
+  for (k = 0; k < num_syms; k++)
+    {
+      GArray *keycodes;
+      int keycode_int = keycode;
+
+      keycodes = g_hash_table_lookup (index_data->keysym_keycodes,
+                                      GUINT_TO_POINTER (syms[k]));
+      if (keycodes == NULL)
+        {
+          keycodes = g_array_new (FALSE, FALSE, sizeof (int));
+          g_hash_table_insert (index_data->keysym_keycodes,
+                               GUINT_TO_POINTER (syms[k]), keycodes);
+        }
+
+      g_array_append_val (keycodes, keycode_int);
+    }
+}
+
+/* Builds the keysym -> keycodes map used to resolve key combos, so that
+ * resolving each combo doesn't need to scan the whole keymap. The keycodes
+ * for a keysym are stored in the order the old per-keysym scan found them
+ * (by layout, then level, then keycode), so the first one is still the one
+ * bindings get resolved to.
+ */
+static void
+reload_keysym_index (MetaKeyBindingManager *keys)
+{
+  MetaBackend *backend = meta_get_backend ();
+  struct xkb_keymap *keymap = meta_backend_get_keymap (backend);
+  IndexKeysymsData index_data;
+  xkb_layout_index_t i;
+  xkb_level_index_t j;
+
+  determine_keymap_num_levels (keys);
+
+  g_hash_table_remove_all (keys->keysym_keycodes);
+
+  index_data.keysym_keycodes = keys->keysym_keycodes;
+  for (i = 0; i < xkb_keymap_num_layouts (keymap); i++)
+    for (j = 0; j < keys->keymap_num_levels; j++)
+      {
+        index_data.layout = i;
+        index_data.level = j;
+        xkb_keymap_key_for_each (keymap, index_keysyms_iter, &index_data);
+      }
+
+  meta_topic (META_DEBUG_KEYBINDINGS,
+              "Indexed %u keysyms over %u layouts and %u levels\n",
+              g_hash_table_size (keys->keysym_keycodes),
+              xkb_keymap_num_layouts (keymap),
+              keys->keymap_num_levels);
+}
+
 static void
 reload_iso_next_group_combos (MetaKeyBindingManager *keys)
 {
@@ -548,8 +572,6 @@ reload_combos (MetaKeyBindingManager *keys)
 {
   g_hash_table_remove_all (keys->key_bindings_index);
 
-  determine_keymap_num_levels (keys);
-
   resolve_key_combo (keys,
                      &keys->overlay_key_combo,
                      &keys->overlay_resolved_key_combo);
@@ -647,38 +669,115 @@ rebuild_special_bindings (MetaKeyBindingManager *keys)
   keys->overlay_key_combo = combo;
 }
 
+static void
+add_window_grab_foreach (gpointer key,
+                         gpointer value,
+                         gpointer user_data)
+{
+  GArray *grab_set = user_data;
+  MetaKeyBinding *binding = value;
+  guint32 combo_key;
+
+  if ((binding->flags & META_KEY_BINDING_PER_WINDOW) == 0)
+    return;
+
+  if (binding->resolved_combo.keycode == 0)
+    return;
+
+  combo_key = key_combo_key (&binding->resolved_combo);
+  g_array_append_val (grab_set, combo_key);
+}
+
+static gint
+compare_combo_keys (gconstpointer a,
+                    gconstpointer b)
+{
+  guint32 key_a = *(const guint32 *) a;
+  guint32 key_b = *(const guint32 *) b;
+
+  return key_a < key_b ? -1 : (key_a > key_b ? 1 : 0);
+}
+
+/* The combos the per-window bindings grab on every window, sorted, with
+ * the ignored modifier mask they are grabbed with appended.
+ */
+static GArray *
+get_window_grab_set (MetaKeyBindingManager *keys)
+{
+  GArray *grab_set;
+  guint32 ignored_mask;
+
+  grab_set = g_array_new (FALSE, FALSE, sizeof (guint32));
+  g_hash_table_foreach (keys->key_bindings, add_window_grab_foreach, grab_set);
+  g_array_sort (grab_set, compare_combo_keys);
+
+  ignored_mask = keys->ignored_modifier_mask;
+  g_array_append_val (grab_set, ignored_mask);
+
+  return grab_set;
+}
+
+static gboolean
+grab_sets_equal (GArray *a,
+                 GArray *b)
+{
+  return a->len == b->len &&
+         memcmp (a->data, b->data, a->len * sizeof (guint32)) == 0;
+}
+
+/* Ungrabs the screen bindings and remembers what the windows have
+ * grabbed; the per-window grabs are only redone by grab_key_bindings()
+ * if the bindings changed in between.
+ */
 static void
 ungrab_key_bindings (MetaDisplay *display)
 {
-  GSList *windows, *l;
+  MetaKeyBindingManager *keys = &display->key_binding_manager;
 
-  meta_screen_ungrab_keys (display->screen);
+  keys->n_grab_requests_before_rebind = keys->n_grab_requests;
 
-  windows = meta_display_list_windows (display, META_LIST_DEFAULT);
-  for (l = windows; l; l = l->next)
-    {
-      MetaWindow *w = l->data;
-      meta_window_ungrab_keys (w);
-    }
+  meta_screen_ungrab_keys (display->screen);
 
-  g_slist_free (windows);
+  g_clear_pointer (&keys->window_grab_set, g_array_unref);
+  keys->window_grab_set = get_window_grab_set (keys);
 }
 
 static void
 grab_key_bindings (MetaDisplay *display)
 {
+  MetaKeyBindingManager *keys = &display->key_binding_manager;
+  GArray *grab_set;
   GSList *windows, *l;
 
   meta_screen_grab_keys (display->screen);
 
-  windows = meta_display_list_windows (display, META_LIST_DEFAULT);
-  for (l = windows; l; l = l->next)
+  grab_set = get_window_grab_set (keys);
+
+  if (keys->window_grab_set && grab_sets_equal (keys->window_grab_set, grab_set))
     {
-      MetaWindow *w = l->data;
-      meta_window_grab_keys (w);
+      meta_topic (META_DEBUG_KEYBINDINGS,
+                  "Per-window key grabs unchanged, not regrabbing windows\n");
     }
+  else
+    {
+      windows = meta_display_list_windows (display, META_LIST_DEFAULT);
+      for (l = windows; l; l = l->next)
+        {
+          MetaWindow *w = l->data;
+          meta_window_ungrab_keys (w);
+          meta_window_grab_keys (w);
+        }
+
+      g_slist_free (windows);
+    }
+
+  g_array_unref (grab_set);
+  g_clear_pointer (&keys->window_grab_set, g_array_unref);
 
-  g_slist_free (windows);
+  meta_topic (META_DEBUG_KEYBINDINGS,
+              "Rebinding keys took %u grab requests (%u in total)\n",
+              keys->n_grab_requests - keys->n_grab_requests_before_rebind,
+              keys->n_grab_requests);
 }
 
 static MetaKeyBinding *
@@ -889,6 +988,38 @@ on_keymap_changed (MetaBackend *backend,
   grab_key_bindings (display);
 }
 
+/* Number of combinations of ignored modifiers */
+static int
+get_n_grab_modifiers (MetaKeyBindingManager *keys)
+{
+  return 1 << __builtin_popcount (keys->ignored_modifier_mask);
+}
+
+/* Fills @mods with @modmask combined with every combination of ignored
+ * modifiers, so that a single passive grab request covers all of them.
+ * X provides no better way to ignore modifiers. @mods must have room for
+ * get_n_grab_modifiers() entries.
+ */
+static int
+get_grab_modifiers (MetaKeyBindingManager *keys,
+                    unsigned int           modmask,
+                    XIGrabModifiers       *mods)
+{
+  unsigned int ignored_mask = keys->ignored_modifier_mask;
+  unsigned int submask = 0;
+  int n_mods = 0;
+
+  /* Walks all subsets of ignored_mask in increasing order */
+  do
+    {
+      mods[n_mods++] = (XIGrabModifiers) { modmask | submask, 0 };
+      submask = (submask - ignored_mask) & ignored_mask;
+    }
+  while (submask != 0);
+
+  return n_mods;
+}
+
 static void
 meta_change_button_grab (MetaKeyBindingManager *keys,
                          Window                  xwindow,
@@ -900,46 +1031,33 @@ meta_change_button_grab (MetaKeyBindingManager *keys,
   MetaBackendX11 *backend = META_BACKEND_X11 (meta_get_backend ());
   Display *xdisplay = meta_backend_x11_get_xdisplay (backend);
 
-  unsigned int ignored_mask;
   unsigned char mask_bits[XIMaskLen (XI_LASTEVENT)] = { 0 };
   XIEventMask mask = { XIAllMasterDevices, sizeof (mask_bits), mask_bits };
+  XIGrabModifiers *mods;
+  int n_mods;
 
   XISetMask (mask.mask, XI_ButtonPress);
   XISetMask (mask.mask, XI_ButtonRelease);
   XISetMask (mask.mask, XI_Motion);
 
-  ignored_mask = 0;
-  while (ignored_mask <= keys->ignored_modifier_mask)
-    {
-      XIGrabModifiers mods;
-
-      if (ignored_mask & ~(keys->ignored_modifier_mask))
-        {
-          /* Not a combination of ignored modifiers
-           * (it contains some non-ignored modifiers)
-           */
-          ++ignored_mask;
-          continue;
-        }
+  mods = g_newa (XIGrabModifiers, get_n_grab_modifiers (keys));
+  n_mods = get_grab_modifiers (keys, modmask, mods);
 
-      mods = (XIGrabModifiers) { modmask | ignored_mask, 0 };
+  /* GrabModeSync means freeze until XAllowEvents */
 
-      /* GrabModeSync means freeze until XAllowEvents */
-
-      if (grab)
-        XIGrabButton (xdisplay,
-                      META_VIRTUAL_CORE_POINTER_ID,
-                      button, xwindow, None,
-                      sync ? XIGrabModeSync : XIGrabModeAsync,
-                      XIGrabModeAsync, False,
-                      &mask, 1, &mods);
-      else
-        XIUngrabButton (xdisplay,
-                        META_VIRTUAL_CORE_POINTER_ID,
-                        button, xwindow, 1, &mods);
+  if (grab)
+    XIGrabButton (xdisplay,
+                  META_VIRTUAL_CORE_POINTER_ID,
+                  button, xwindow, None,
+                  sync ? XIGrabModeSync : XIGrabModeAsync,
+                  XIGrabModeAsync, False,
+                  &mask, n_mods, mods);
+  else
+    XIUngrabButton (xdisplay,
+                    META_VIRTUAL_CORE_POINTER_ID,
+                    button, xwindow, n_mods, mods);
 
-      ++ignored_mask;
-    }
+  keys->n_grab_requests++;
 }
 
 ClutterModifierType
@@ -1144,6 +1262,8 @@ meta_display_shutdown_keys (MetaDisplay *display)
 
   g_hash_table_destroy (keys->key_bindings_index);
   g_hash_table_destroy (keys->key_bindings);
+  g_hash_table_destroy (keys->keysym_keycodes);
+  g_clear_pointer (&keys->window_grab_set, g_array_unref);
 }
 
 /* Grab/ungrab, ignoring all annoying modifiers like NumLock etc. */
@@ -1153,10 +1273,10 @@ meta_change_keygrab (MetaKeyBindingManager *keys,
                      gboolean               grab,
                      MetaResolvedKeyCombo  *resolved_combo)
 {
-  unsigned int ignored_mask;
-
   unsigned char mask_bits[XIMaskLen (XI_LASTEVENT)] = { 0 };
   XIEventMask mask = { XIAllMasterDevices, sizeof (mask_bits), mask_bits };
+  XIGrabModifiers *mods;
+  int n_mods;
 
   XISetMask (mask.mask, XI_KeyPress);
   XISetMask (mask.mask, XI_KeyRelease);
@@ -1164,45 +1284,28 @@ meta_change_keygrab (MetaKeyBindingManager *keys,
   MetaBackendX11 *backend = META_BACKEND_X11 (meta_get_backend ());
   Display *xdisplay = meta_backend_x11_get_xdisplay (backend);
 
-  /* Grab keycode/modmask, together with
-   * all combinations of ignored modifiers.
-   * X provides no better way to do this.
-   */
-
   meta_topic (META_DEBUG_KEYBINDINGS,
               "%s keybinding keycode %d mask 0x%x on 0x%lx\n",
               grab ? "Grabbing" : "Ungrabbing",
               resolved_combo->keycode, resolved_combo->mask, xwindow);
 
-  ignored_mask = 0;
-  while (ignored_mask <= keys->ignored_modifier_mask)
-    {
-      XIGrabModifiers mods;
-
-      if (ignored_mask & ~(keys->ignored_modifier_mask))
-        {
-          /* Not a combination of ignored modifiers
-           * (it contains some non-ignored modifiers)
-           */
-          ++ignored_mask;
-          continue;
-        }
-
-      mods = (XIGrabModifiers) { resolved_combo->mask | ignored_mask, 0 };
-
-      if (grab)
-        XIGrabKeycode (xdisplay,
-                       META_VIRTUAL_CORE_KEYBOARD_ID,
-                       resolved_combo->keycode, xwindow,
-                       XIGrabModeSync, XIGrabModeAsync,
-                       False, &mask, 1, &mods);
-      else
-        XIUngrabKeycode (xdisplay,
-                         META_VIRTUAL_CORE_KEYBOARD_ID,
-                         resolved_combo->keycode, xwindow, 1, &mods);
+  /* All combinations of ignored modifiers go in one request; the
+   * grab request needs a reply, so this also saves round trips. */
+  mods = g_newa (XIGrabModifiers, get_n_grab_modifiers (keys));
+  n_mods = get_grab_modifiers (keys, resolved_combo->mask, mods);
+
+  if (grab)
+    XIGrabKeycode (xdisplay,
+                   META_VIRTUAL_CORE_KEYBOARD_ID,
+                   resolved_combo->keycode, xwindow,
+                   XIGrabModeSync, XIGrabModeAsync,
+                   False, &mask, n_mods, mods);
+  else
+    XIUngrabKeycode (xdisplay,
+                     META_VIRTUAL_CORE_KEYBOARD_ID,
+                     resolved_combo->keycode, xwindow, n_mods, mods);
 
-      ++ignored_mask;
-    }
+  keys->n_grab_requests++;
 }
 
 typedef struct
@@ -1304,7 +1407,23 @@ change_window_keygrabs (MetaKeyBindingManager *keys,
                         Window                 xwindow,
                         gboolean               grab)
 {
-  change_binding_keygrabs (keys, xwindow, TRUE, grab);
+  if (grab)
+    {
+      change_binding_keygrabs (keys, xwindow, TRUE, TRUE);
+    }
+  else
+    {
+      MetaBackendX11 *backend = META_BACKEND_X11 (meta_get_backend ());
+      Display *xdisplay = meta_backend_x11_get_xdisplay (backend);
+      XIGrabModifiers mods = { XIAnyModifier, 0 };
+
+      /* Only per-window bindings are grabbed on client and frame
+       * windows, so drop them all at once; this also doesn't depend on
+       * the combos they were grabbed with still being resolvable. */
+      XIUngrabKeycode (xdisplay, META_VIRTUAL_CORE_KEYBOARD_ID,
+                       XIAnyKeycode, xwindow, 1, &mods);
+      keys->n_grab_requests++;
+    }
 }
 
 void
@@ -4049,6 +4168,8 @@ meta_display_init_keys (MetaDisplay *display)
 
   keys->key_bindings = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) meta_key_binding_free);
   keys->key_bindings_index = g_hash_table_new (NULL, NULL);
+  keys->keysym_keycodes = g_hash_table_new_full (NULL, NULL, NULL,
+                                                 (GDestroyNotify) g_array_unref);
 
   reload_modmap (keys);
 
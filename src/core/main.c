@@ -77,6 +77,7 @@
 #endif
 
 #include "x11/session.h"
+#include "x11/roundtrip-audit.h"
 
 #ifdef HAVE_WAYLAND
 #include "wayland/meta-wayland.h"
@@ -317,6 +318,7 @@ meta_init (void)
 #endif
 
   g_unix_signal_add (SIGTERM, on_sigterm, NULL);
+  meta_roundtrip_audit_init ();
 
   if (g_getenv ("MUTTER_VERBOSE"))
     meta_set_verbose (TRUE);
@@ -436,6 +438,7 @@ meta_run (void)
 
   g_main_loop_run (meta_main_loop);
 
+  meta_roundtrip_audit_dump ();
   meta_finalize ();
 
   return meta_exit_code;
@@ -359,49 +359,177 @@ avoid_being_obscured_as_second_modal_dialog (MetaWindow *window,
     }
 }
 
+/* find_first_fit() tries a couple of candidate positions for every
+ * existing window, each of which has to be checked against all the other
+ * windows.  To keep that from being quadratic in the number of windows,
+ * their frame rects get bucketed into a coarse grid over the screen once
+ * per placement, and candidates are only tested against the windows in the
+ * grid cells they cover.
+ */
+#define PLACEMENT_GRID_CELL_SIZE 256
+
+typedef struct
+{
+  MetaRectangle  bounds;
+  int            n_columns;
+  int            n_rows;
+  MetaRectangle *rects;
+  GArray       **cells;
+} PlacementIndex;
+
 static gboolean
-rectangle_overlaps_some_window (MetaRectangle *rect,
-                                GList         *windows)
+window_can_be_overlapped (MetaWindow *window)
 {
-  GList *tmp;
-  MetaRectangle dest;
+  switch (window->type)
+    {
+    case META_WINDOW_DOCK:
+    case META_WINDOW_SPLASHSCREEN:
+    case META_WINDOW_DESKTOP:
+    case META_WINDOW_DIALOG:
+    case META_WINDOW_MODAL_DIALOG:
+    /* override redirect window types: */
+    case META_WINDOW_DROPDOWN_MENU:
+    case META_WINDOW_POPUP_MENU:
+    case META_WINDOW_TOOLTIP:
+    case META_WINDOW_NOTIFICATION:
+    case META_WINDOW_COMBO:
+    case META_WINDOW_DND:
+    case META_WINDOW_OVERRIDE_OTHER:
+      return FALSE;
 
-  tmp = windows;
-  while (tmp != NULL)
+    case META_WINDOW_NORMAL:
+    case META_WINDOW_UTILITY:
+    case META_WINDOW_TOOLBAR:
+    case META_WINDOW_MENU:
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Maps a span of pixels onto the range of grid cells it covers; anything
+ * outside the grid is clamped onto the outermost cells, which keeps
+ * overlapping spans on overlapping cell ranges.
+ */
+static void
+placement_index_span (int  origin,
+                      int  n_cells,
+                      int  start,
+                      int  length,
+                      int *first_cell,
+                      int *last_cell)
+{
+  int first = start - origin;
+  int last = start + length - 1 - origin;
+
+  first = first < 0 ? 0 : first / PLACEMENT_GRID_CELL_SIZE;
+  last = last < 0 ? 0 : last / PLACEMENT_GRID_CELL_SIZE;
+
+  *first_cell = MIN (first, n_cells - 1);
+  *last_cell = MIN (last, n_cells - 1);
+}
+
+static void
+placement_index_init (PlacementIndex *index,
+                      MetaScreen     *screen,
+                      GList          *windows)
+{
+  GList *tmp;
+  int i;
+
+  index->bounds = screen->rect;
+  index->n_columns = MAX (1, (index->bounds.width + PLACEMENT_GRID_CELL_SIZE - 1) /
+                             PLACEMENT_GRID_CELL_SIZE);
+  index->n_rows = MAX (1, (index->bounds.height + PLACEMENT_GRID_CELL_SIZE - 1) /
+                          PLACEMENT_GRID_CELL_SIZE);
+  index->rects = g_new (MetaRectangle, g_list_length (windows));
+  index->cells = g_new0 (GArray *, index->n_columns * index->n_rows);
+
+  i = 0;
+  for (tmp = windows; tmp != NULL; tmp = tmp->next)
     {
       MetaWindow *other = tmp->data;
-      MetaRectangle other_rect;
+      MetaRectangle *rect = &index->rects[i];
+      int first_column, last_column, first_row, last_row;
+      int column, row;
+
+      if (!window_can_be_overlapped (other))
+        continue;
+
+      meta_window_get_frame_rect (other, rect);
+      if (rect->width <= 0 || rect->height <= 0)
+        continue;
+
+      placement_index_span (index->bounds.x, index->n_columns,
+                            rect->x, rect->width,
+                            &first_column, &last_column);
+      placement_index_span (index->bounds.y, index->n_rows,
+                            rect->y, rect->height,
+                            &first_row, &last_row);
+
+      for (row = first_row; row <= last_row; row++)
+        for (column = first_column; column <= last_column; column++)
+          {
+            GArray **cell = &index->cells[row * index->n_columns + column];
+
+            if (*cell == NULL)
+              *cell = g_array_new (FALSE, FALSE, sizeof (int));
+            g_array_append_val (*cell, i);
+          }
+
+      i++;
+    }
+}
 
-      switch (other->type)
-        {
-        case META_WINDOW_DOCK:
-        case META_WINDOW_SPLASHSCREEN:
-        case META_WINDOW_DESKTOP:
-        case META_WINDOW_DIALOG:
-        case META_WINDOW_MODAL_DIALOG:
-	/* override redirect window types: */
-	case META_WINDOW_DROPDOWN_MENU:
-	case META_WINDOW_POPUP_MENU:
-	case META_WINDOW_TOOLTIP:
-	case META_WINDOW_NOTIFICATION:
-	case META_WINDOW_COMBO:
-	case META_WINDOW_DND:
-	case META_WINDOW_OVERRIDE_OTHER:
-          break;
+static void
+placement_index_destroy (PlacementIndex *index)
+{
+  int i;
 
-        case META_WINDOW_NORMAL:
-        case META_WINDOW_UTILITY:
-        case META_WINDOW_TOOLBAR:
-        case META_WINDOW_MENU:
-          meta_window_get_frame_rect (other, &other_rect);
+  for (i = 0; i < index->n_columns * index->n_rows; i++)
+    if (index->cells[i])
+      g_array_free (index->cells[i], TRUE);
 
-          if (meta_rectangle_intersect (rect, &other_rect, &dest))
-            return TRUE;
-          break;
-        }
+  g_free (index->cells);
+  g_free (index->rects);
+}
 
-      tmp = tmp->next;
-    }
+static gboolean
+rectangle_overlaps_some_window (MetaRectangle  *rect,
+                                PlacementIndex *index)
+{
+  MetaRectangle dest;
+  int first_column, last_column, first_row, last_row;
+  int column, row;
+  guint i;
+
+  if (rect->width <= 0 || rect->height <= 0)
+    return FALSE;
+
+  placement_index_span (index->bounds.x, index->n_columns,
+                        rect->x, rect->width,
+                        &first_column, &last_column);
+  placement_index_span (index->bounds.y, index->n_rows,
+                        rect->y, rect->height,
+                        &first_row, &last_row);
+
+  for (row = first_row; row <= last_row; row++)
+    for (column = first_column; column <= last_column; column++)
+      {
+        GArray *cell = index->cells[row * index->n_columns + column];
+
+        if (cell == NULL)
+          continue;
+
+        for (i = 0; i < cell->len; i++)
+          {
+            MetaRectangle *other_rect =
+              &index->rects[g_array_index (cell, int, i)];
+
+            if (meta_rectangle_intersect (rect, other_rect, &dest))
+              return TRUE;
+          }
+      }
 
   return FALSE;
 }
@@ -499,9 +627,12 @@ find_first_fit (MetaWindow *window,
   GList *tmp;
   MetaRectangle rect;
   MetaRectangle work_area;
+  PlacementIndex index;
 
   retval = FALSE;
 
+  placement_index_init (&index, window->screen, windows);
+
   /* Below each window */
   below_sorted = g_list_copy (windows);
   below_sorted = g_list_sort (below_sorted, leftmost_cmp);
@@ -530,7 +661,7 @@ find_first_fit (MetaWindow *window,
   center_tile_rect_in_area (&rect, &work_area);
 
   if (meta_rectangle_contains_rect (&work_area, &rect) &&
-      !rectangle_overlaps_some_window (&rect, windows))
+      !rectangle_overlaps_some_window (&rect, &index))
     {
       *new_x = rect.x;
       *new_y = rect.y;
@@ -553,7 +684,7 @@ find_first_fit (MetaWindow *window,
       rect.y = frame_rect.y + frame_rect.height;
 
       if (meta_rectangle_contains_rect (&work_area, &rect) &&
-          !rectangle_overlaps_some_window (&rect, below_sorted))
+          !rectangle_overlaps_some_window (&rect, &index))
         {
           *new_x = rect.x;
           *new_y = rect.y;
@@ -579,7 +710,7 @@ find_first_fit (MetaWindow *window,
       rect.y = frame_rect.y;
 
       if (meta_rectangle_contains_rect (&work_area, &rect) &&
-          !rectangle_overlaps_some_window (&rect, right_sorted))
+          !rectangle_overlaps_some_window (&rect, &index))
         {
           *new_x = rect.x;
           *new_y = rect.y;
@@ -595,6 +726,7 @@ find_first_fit (MetaWindow *window,
  out:
   g_list_free (below_sorted);
   g_list_free (right_sorted);
+  placement_index_destroy (&index);
   return retval;
 }
 
@@ -94,6 +94,7 @@ struct _MetaScreen
   Window wm_cm_selection_window;
   guint work_area_later;
   guint check_fullscreen_later;
+  guint fullscreen_dirty_monitors;
 
   int rows_of_workspaces;
   int columns_of_workspaces;
@@ -168,6 +169,8 @@ void          meta_screen_update_workspace_layout (MetaScreen             *scree
 void          meta_screen_update_workspace_names  (MetaScreen             *screen);
 void          meta_screen_queue_workarea_recalc   (MetaScreen             *screen);
 void          meta_screen_queue_check_fullscreen  (MetaScreen             *screen);
+void          meta_screen_queue_check_fullscreen_for_window (MetaScreen *screen,
+                                                             MetaWindow *window);
 
 
 Window meta_create_offscreen_window (Display *xdisplay,
@@ -56,6 +56,7 @@
 
 #include "x11/window-x11.h"
 #include "x11/xprops.h"
+#include "x11/roundtrip-audit.h"
 
 #include "backends/x11/meta-backend-x11.h"
 
@@ -481,7 +482,7 @@ create_guard_window (Display *xdisplay, MetaScreen *screen)
         /* Sync on the connection we created the window on to
          * make sure it's created before we select on it on the
          * backend connection. */
-        XSync (xdisplay, False);
+        META_X_ROUNDTRIP ("XSync", XSync (xdisplay, False));
 
         XISelectEvents (backend_xdisplay, guard_window, &mask, 1);
       }
@@ -860,22 +861,22 @@ void
 meta_screen_manage_all_windows (MetaScreen *screen)
 {
   guint64 *_children;
-  guint64 *children;
+  Window *children;
   int n_children, i;
 
   meta_stack_freeze (screen->stack);
   meta_stack_tracker_get_stack (screen->stack_tracker, &_children, &n_children);
 
   /* Copy the stack as it will be modified as part of the loop */
-  children = g_memdup (_children, sizeof (guint64) * n_children);
-
+  children = g_new (Window, n_children);
   for (i = 0; i < n_children; ++i)
     {
-      g_assert (META_STACK_ID_IS_X11 (children[i]));
-      meta_window_x11_new (screen->display, children[i], TRUE,
-                           META_COMP_EFFECT_NONE);
+      g_assert (META_STACK_ID_IS_X11 (_children[i]));
+      children[i] = _children[i];
     }
 
+  meta_window_x11_manage_existing (screen->display, children, n_children);
+
   g_free (children);
   meta_stack_thaw (screen->stack);
 }
@@ -3039,56 +3040,115 @@ meta_screen_set_active_workspace_hint (MetaScreen *screen)
   meta_error_trap_pop (screen->display);
 }
 
+/* Monitors past the 31st share the last bit of the dirty masks, so
+ * they are simply re-evaluated together.
+ */
+#define FULLSCREEN_MONITOR_BIT(i) (1u << MIN ((i), 31))
+
+/* We consider a monitor in fullscreen if it contains a fullscreen window;
+ * however we make an exception for maximized windows above the fullscreen
+ * one, as in that case window+chrome fully obscure the fullscreen window.
+ */
+static gboolean
+window_covers_monitors (MetaWindow *window)
+{
+  if (window->fullscreen)
+    return TRUE;
+
+  /* We want to handle the case where an application is creating an
+   * override-redirect window the size of the screen (monitor) and treat
+   * it similarly to a fullscreen window, though it doesn't have fullscreen
+   * window management behavior. (Being O-R, it's not managed at all.)
+   */
+  if (window->override_redirect)
+    return meta_window_is_monitor_sized (window);
+
+  return FALSE;
+}
+
+static gboolean
+window_obscures_monitor (MetaWindow *window)
+{
+  return (!window->fullscreen && !window->override_redirect &&
+          window->maximized_horizontally &&
+          window->maximized_vertically);
+}
+
+static guint
+get_window_fullscreen_monitor_mask (MetaScreen *screen,
+                                    MetaWindow *window)
+{
+  guint mask = 0;
+
+  if (window->screen != screen || window->hidden || window->unmanaging ||
+      window->monitor == NULL)
+    return 0;
+
+  if (window_covers_monitors (window))
+    {
+      int *monitors;
+      gsize n_monitors;
+      gsize j;
+
+      monitors = meta_window_get_all_monitors (window, &n_monitors);
+      for (j = 0; j < n_monitors; j++)
+        mask |= FULLSCREEN_MONITOR_BIT (monitors[j]);
+
+      g_free (monitors);
+    }
+  else if (window_obscures_monitor (window))
+    {
+      mask |= FULLSCREEN_MONITOR_BIT (meta_window_get_monitor (window));
+    }
+
+  return mask;
+}
+
 static gboolean
 check_fullscreen_func (gpointer data)
 {
   MetaScreen *screen = data;
   MetaWindow *window;
-  GSList *fullscreen_monitors = NULL;
-  GSList *obscured_monitors = NULL;
+  gboolean *pending;
+  gboolean *fullscreen;
+  guint dirty_monitors;
+  int n_pending = 0;
   gboolean in_fullscreen_changed = FALSE;
   int i;
 
   screen->check_fullscreen_later = 0;
 
-  /* We consider a monitor in fullscreen if it contains a fullscreen window;
-   * however we make an exception for maximized windows above the fullscreen
-   * one, as in that case window+chrome fully obscure the fullscreen window.
+  dirty_monitors = screen->fullscreen_dirty_monitors;
+  screen->fullscreen_dirty_monitors = 0;
+
+  /* Only the monitors that a window started or stopped covering or
+   * obscuring since the last check are re-evaluated; monitors whose
+   * state was never computed are always included.
+   */
+  pending = g_newa (gboolean, screen->n_monitor_infos);
+  fullscreen = g_newa (gboolean, screen->n_monitor_infos);
+  for (i = 0; i < screen->n_monitor_infos; i++)
+    {
+      MetaMonitorInfo *info = &screen->monitor_infos[i];
+
+      pending[i] = ((dirty_monitors & FULLSCREEN_MONITOR_BIT (i)) != 0 ||
+                    info->in_fullscreen == -1);
+      fullscreen[i] = FALSE;
+      if (pending[i])
+        n_pending++;
+    }
+
+  /* The topmost window covering or obscuring a monitor decides its state,
+   * so the walk stops as soon as every pending monitor is resolved.
    */
   for (window = meta_stack_get_top (screen->stack);
-       window;
+       window && n_pending > 0;
        window = meta_stack_get_below (screen->stack, window, FALSE))
     {
-      gboolean covers_monitors = FALSE;
-
       if (window->screen != screen || window->hidden)
         continue;
 
-      if (window->fullscreen)
-        {
-          covers_monitors = TRUE;
-        }
-      else if (window->override_redirect)
-        {
-          /* We want to handle the case where an application is creating an
-           * override-redirect window the size of the screen (monitor) and treat
-           * it similarly to a fullscreen window, though it doesn't have fullscreen
-           * window management behavior. (Being O-R, it's not managed at all.)
-           */
-          if (meta_window_is_monitor_sized (window))
-            covers_monitors = TRUE;
-        }
-      else if (window->maximized_horizontally &&
-               window->maximized_vertically)
-        {
-          int monitor_index = meta_window_get_monitor (window);
-          /* + 1 to avoid NULL */
-          gpointer monitor_p = GINT_TO_POINTER(monitor_index + 1);
-          if (!g_slist_find (obscured_monitors, monitor_p))
-            obscured_monitors = g_slist_prepend (obscured_monitors, monitor_p);
-        }
-
-      if (covers_monitors)
+      if (window_covers_monitors (window))
         {
           int *monitors;
           gsize n_monitors;
@@ -3097,47 +3157,95 @@ check_fullscreen_func (gpointer data)
           monitors = meta_window_get_all_monitors (window, &n_monitors);
           for (j = 0; j < n_monitors; j++)
             {
-              /* + 1 to avoid NULL */
-              gpointer monitor_p = GINT_TO_POINTER(monitors[j] + 1);
-              if (!g_slist_find (fullscreen_monitors, monitor_p) &&
-                  !g_slist_find (obscured_monitors, monitor_p))
-                fullscreen_monitors = g_slist_prepend (fullscreen_monitors, monitor_p);
+              int monitor_index = monitors[j];
+
+              if (pending[monitor_index])
+                {
+                  pending[monitor_index] = FALSE;
+                  fullscreen[monitor_index] = TRUE;
+                  n_pending--;
+                }
             }
 
           g_free (monitors);
         }
-    }
+      else if (window_obscures_monitor (window))
+        {
+          int monitor_index = meta_window_get_monitor (window);
 
-  g_slist_free (obscured_monitors);
+          if (monitor_index >= 0 && pending[monitor_index])
+            {
+              pending[monitor_index] = FALSE;
+              n_pending--;
+            }
+        }
+    }
 
   for (i = 0; i < screen->n_monitor_infos; i++)
     {
       MetaMonitorInfo *info = &screen->monitor_infos[i];
-      gboolean in_fullscreen = g_slist_find (fullscreen_monitors, GINT_TO_POINTER (i + 1)) != NULL;
-      if (in_fullscreen != info->in_fullscreen)
+
+      if (!(dirty_monitors & FULLSCREEN_MONITOR_BIT (i)) &&
+          info->in_fullscreen != -1)
+        continue;
+
+      if (fullscreen[i] != info->in_fullscreen)
         {
-          info->in_fullscreen = in_fullscreen;
+          info->in_fullscreen = fullscreen[i];
           in_fullscreen_changed = TRUE;
         }
     }
 
-  g_slist_free (fullscreen_monitors);
-
   if (in_fullscreen_changed)
     g_signal_emit (screen, screen_signals[IN_FULLSCREEN_CHANGED], 0, NULL);
 
   return FALSE;
 }
 
-void
-meta_screen_queue_check_fullscreen (MetaScreen *screen)
+static void
+queue_check_fullscreen_monitors (MetaScreen *screen,
+                                 guint       dirty_monitors)
 {
+  screen->fullscreen_dirty_monitors |= dirty_monitors;
+
   if (!screen->check_fullscreen_later)
     screen->check_fullscreen_later = meta_later_add (META_LATER_CHECK_FULLSCREEN,
                                                      check_fullscreen_func,
                                                      screen, NULL);
 }
 
+void
+meta_screen_queue_check_fullscreen (MetaScreen *screen)
+{
+  queue_check_fullscreen_monitors (screen, ~0u);
+}
+
+/**
+ * meta_screen_queue_check_fullscreen_for_window:
+ * @screen: a #MetaScreen
+ * @window: a #MetaWindow whose state, geometry or stacking changed
+ *
+ * Queues a re-evaluation of the in-fullscreen state of only those
+ * monitors that @window covers or obscures now, or did at the time
+ * of the previous call. Windows that are neither fullscreen, monitor
+ * sized override-redirect nor maximized don't queue anything.
+ */
+void
+meta_screen_queue_check_fullscreen_for_window (MetaScreen *screen,
+                                               MetaWindow *window)
+{
+  guint old_mask, new_mask;
+
+  old_mask = window->fullscreen_monitor_mask;
+  new_mask = get_window_fullscreen_monitor_mask (screen, window);
+  window->fullscreen_monitor_mask = new_mask;
+
+  if ((old_mask | new_mask) == 0)
+    return;
+
+  queue_check_fullscreen_monitors (screen, old_mask | new_mask);
+}
+
 /**
  * meta_screen_get_monitor_in_fullscreen:
  * @screen: a #MetaScreen
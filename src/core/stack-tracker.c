@@ -41,6 +41,7 @@
 #include "stack-tracker.h"
 #include <meta/errors.h>
 #include <meta/util.h>
+#include "x11/roundtrip-audit.h"
 
 #include <meta/compositor.h>
 
@@ -481,9 +482,10 @@ query_xserver_stack (MetaStackTracker *tracker)
 
   tracker->xserver_serial = XNextRequest (screen->display->xdisplay);
 
-  XQueryTree (screen->display->xdisplay,
-              screen->xroot,
-              &ignored1, &ignored2, &children, &n_children);
+  META_X_ROUNDTRIP ("XQueryTree",
+                    XQueryTree (screen->display->xdisplay,
+                                screen->xroot,
+                                &ignored1, &ignored2, &children, &n_children));
 
   tracker->verified_stack = g_array_sized_new (FALSE, FALSE, sizeof (guint64), n_children);
   g_array_set_size (tracker->verified_stack, n_children);
@@ -72,6 +72,7 @@ meta_stack_new (MetaScreen *screen)
   stack->xwindows = g_array_new (FALSE, FALSE, sizeof (Window));
 
   stack->sorted = NULL;
+  stack->serial = 0;
   stack->added = NULL;
   stack->removed = NULL;
 
@@ -428,7 +429,7 @@ compute_layer (MetaWindow *window)
 
   if (window->layer != old_layer &&
       (old_layer == META_LAYER_FULLSCREEN || window->layer == META_LAYER_FULLSCREEN))
-    meta_screen_queue_check_fullscreen (window->screen);
+    meta_screen_queue_check_fullscreen_for_window (window->screen, window);
 }
 
 /* Front of the layer list is the topmost window,
@@ -1012,6 +1013,10 @@ stack_do_resort (MetaStack *stack)
 static void
 stack_ensure_sorted (MetaStack *stack)
 {
+  if (stack->added || stack->removed ||
+      stack->need_relayer || stack->need_constrain || stack->need_resort)
+    stack->serial++;
+
   stack_do_window_deletions (stack);
   stack_do_window_additions (stack);
   stack_do_relayer (stack);
@@ -1346,6 +1351,14 @@ meta_stack_windows_cmp  (MetaStack  *stack,
     return 0; /* not reached */
 }
 
+guint64
+meta_stack_get_serial (MetaStack *stack)
+{
+  stack_ensure_sorted (stack);
+
+  return stack->serial;
+}
+
 static int
 compare_just_window_stack_position (void *a,
                                     void *b)
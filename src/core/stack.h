@@ -63,6 +63,13 @@ struct _MetaStack
   /** The MetaWindows of the windows we manage, sorted in order. */
   GList *sorted;
 
+  /**
+   * Bumped every time stack_ensure_sorted() brings "sorted" up to date
+   * after windows were added, removed, relayered or moved, so that
+   * caches derived from the stacking order can tell when they are stale.
+   */
+  guint64 serial;
+
   /**
    * MetaWindows waiting to be added to the "sorted" and "windows" list, after
    * being added by meta_stack_add() and before being assimilated by
@@ -374,6 +381,17 @@ int         meta_stack_windows_cmp  (MetaStack  *stack,
                                      MetaWindow *window_a,
                                      MetaWindow *window_b);
 
+/**
+ * meta_stack_get_serial:
+ * @stack: The stack to examine.
+ *
+ * Brings the stack up to date and returns its serial, which changes
+ * whenever the stacking order of its windows may have changed.
+ *
+ * \return The current serial of the stack.
+ */
+guint64     meta_stack_get_serial   (MetaStack  *stack);
+
 /**
  * meta_window_set_stack_position:
  * @window: The window which is moving.
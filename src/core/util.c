@@ -737,9 +737,31 @@ typedef struct
   GDestroyNotify notify;
   int source;
   gboolean run_once;
+  GList *link;
 } MetaLater;
 
-static GSList *laters = NULL;
+#define N_LATER_TYPES (META_LATER_IDLE + 1)
+
+/* One FIFO queue per phase, and an ID => later table so that removal
+ * doesn't have to search the queues.
+ */
+static GQueue laters[N_LATER_TYPES];
+static GHashTable *laters_by_id = NULL;
+
+/* How long each phase ran for during the last frame, in microseconds */
+static gint64 later_run_time[N_LATER_TYPES];
+
+#ifdef WITH_VERBOSE_MODE
+static const char * const later_type_names[N_LATER_TYPES] = {
+  "RESIZE",
+  "CALC_SHOWING",
+  "CHECK_FULLSCREEN",
+  "SYNC_STACK",
+  "BEFORE_REDRAW",
+  "IDLE"
+};
+#endif
+
 /* This is a dummy timeline used to get the Clutter master clock running */
 static ClutterTimeline *later_timeline;
 static guint later_repaint_func = 0;
@@ -772,56 +794,71 @@ destroy_later (MetaLater *later)
   unref_later (later);
 }
 
-/* Used to sort the list of laters with the highest priority
- * functions first.
- */
-static int
-compare_laters (gconstpointer a,
-                gconstpointer b)
-{
-  return ((const MetaLater *)a)->when - ((const MetaLater *)b)->when;
-}
-
 static gboolean
 run_repaint_laters (gpointer data)
 {
-  GSList *laters_copy;
-  GSList *l;
   gboolean keep_timeline_running = FALSE;
+  int when;
 
-  laters_copy = NULL;
-  for (l = laters; l; l = l->next)
+  /* Run the phases in order; laters queued by an earlier phase (say, a
+   * resize queueing a calc_showing) get run in this same frame.
+   */
+  for (when = META_LATER_RESIZE; when <= META_LATER_BEFORE_REDRAW; when++)
     {
-      MetaLater *later = l->data;
-      if (later->source == 0 ||
-          (later->when <= META_LATER_BEFORE_REDRAW && !later->run_once))
+      GSList *laters_copy;
+      GSList *l;
+      GList *q;
+      gint64 start_time;
+
+      laters_copy = NULL;
+      for (q = laters[when].head; q; q = q->next)
         {
-          later->ref_count++;
-          laters_copy = g_slist_prepend (laters_copy, later);
+          MetaLater *later = q->data;
+          if (later->source == 0 || !later->run_once)
+            {
+              later->ref_count++;
+              laters_copy = g_slist_prepend (laters_copy, later);
+            }
         }
-    }
-  laters_copy = g_slist_reverse (laters_copy);
 
-  for (l = laters_copy; l; l = l->next)
-    {
-      MetaLater *later = l->data;
+      if (laters_copy == NULL)
+        {
+          later_run_time[when] = 0;
+          continue;
+        }
+
+      laters_copy = g_slist_reverse (laters_copy);
 
-      if (later->func && later->func (later->data))
+      start_time = g_get_monotonic_time ();
+
+      for (l = laters_copy; l; l = l->next)
         {
-          if (later->source == 0)
-            keep_timeline_running = TRUE;
+          MetaLater *later = l->data;
+
+          if (later->func && later->func (later->data))
+            {
+              if (later->source == 0)
+                keep_timeline_running = TRUE;
+            }
+          else
+            meta_later_remove (later->id);
+          unref_later (later);
         }
-      else
-        meta_later_remove (later->id);
-      unref_later (later);
+
+      later_run_time[when] = g_get_monotonic_time () - start_time;
+
+      meta_topic (META_DEBUG_COMPOSITOR,
+                  "Ran %u %s laters in %" G_GINT64_FORMAT " us\n",
+                  g_slist_length (laters_copy), later_type_names[when],
+                  later_run_time[when]);
+
+      g_slist_free (laters_copy);
     }
 
   if (!keep_timeline_running)
     clutter_timeline_stop (later_timeline);
 
-  g_slist_free (laters_copy);
-
-  /* Just keep the repaint func around - it's cheap if the list is empty */
+  /* Just keep the repaint func around - it's cheap if the queues are empty */
   return TRUE;
 }
 
@@ -888,7 +925,12 @@ meta_later_add (MetaLaterType  when,
   later->data = data;
   later->notify = notify;
 
-  laters = g_slist_insert_sorted (laters, later, compare_laters);
+  if (laters_by_id == NULL)
+    laters_by_id = g_hash_table_new (NULL, NULL);
+
+  g_queue_push_tail (&laters[when], later);
+  later->link = laters[when].tail;
+  g_hash_table_insert (laters_by_id, GUINT_TO_POINTER (later->id), later);
 
   switch (when)
     {
@@ -929,21 +971,23 @@ meta_later_add (MetaLaterType  when,
 void
 meta_later_remove (guint later_id)
 {
-  GSList *l;
+  MetaLater *later;
 
-  for (l = laters; l; l = l->next)
-    {
-      MetaLater *later = l->data;
-      if (later->id == later_id)
-        {
-          laters = g_slist_delete_link (laters, l);
-          /* If this was a "repaint func" later, we just let the
-           * repaint func run and get removed
-           */
-          destroy_later (later);
-          return;
-        }
-    }
+  if (laters_by_id == NULL)
+    return;
+
+  later = g_hash_table_lookup (laters_by_id, GUINT_TO_POINTER (later_id));
+  if (later == NULL)
+    return;
+
+  g_hash_table_remove (laters_by_id, GUINT_TO_POINTER (later_id));
+  g_queue_delete_link (&laters[later->when], later->link);
+  later->link = NULL;
+
+  /* If this was a "repaint func" later, we just let the
+   * repaint func run and get removed
+   */
+  destroy_later (later);
 }
 
 MetaLocaleDirection
@@ -96,6 +96,17 @@ struct _MetaWindow
   MetaScreen *screen;
   guint64 stamp;
   const MetaMonitorInfo *monitor;
+  /* Monitors this window last covered or obscured for the purposes of
+   * in-fullscreen tracking; see meta_screen_queue_check_fullscreen_for_window()
+   */
+  guint fullscreen_monitor_mask;
+  /* Our link in display->mru_list, if we are in it */
+  GList *display_mru_link;
+  /* Our position in display->window_index and display->stacked_windows,
+   * or -1 if we are not in them
+   */
+  int display_index;
+  int stacked_index;
   MetaWorkspace *workspace;
   MetaWindowClientType client_type;
   MetaWaylandSurface *surface;
@@ -678,8 +689,7 @@ void meta_window_set_urgent (MetaWindow *window,
 
 void meta_window_update_resize (MetaWindow *window,
                                 gboolean    snap,
-                                int x, int y,
-                                gboolean force);
+                                int x, int y);
 
 void meta_window_move_resize_internal (MetaWindow          *window,
                                        MetaMoveResizeFlags  flags,
@@ -106,8 +106,7 @@ static gboolean update_move_timeout   (gpointer data);
 static void     update_resize         (MetaWindow   *window,
                                        gboolean      snap,
                                        int           x,
-                                       int           y,
-                                       gboolean      force);
+                                       int           y);
 static gboolean update_resize_timeout (gpointer data);
 static gboolean should_be_on_all_workspaces (MetaWindow *window);
 
@@ -987,6 +986,8 @@ _meta_window_shared_new (MetaDisplay         *display,
 
   window->layer = META_LAYER_LAST; /* invalid value */
   window->stack_position = -1;
+  window->display_index = -1;
+  window->stacked_index = -1;
   window->initial_workspace = 0; /* not used */
   window->initial_timestamp = 0; /* not used */
 
@@ -1016,6 +1017,7 @@ _meta_window_shared_new (MetaDisplay         *display,
     }
 
   META_WINDOW_GET_CLASS (window)->manage (window);
+  meta_display_add_window_to_index (window->display, window);
 
   if (!window->override_redirect)
     meta_window_update_icon_now (window, TRUE);
@@ -1070,6 +1072,9 @@ _meta_window_shared_new (MetaDisplay         *display,
         meta_display_get_current_time_roundtrip (window->display);
   }
 
+  if (!window->override_redirect)
+    meta_display_update_window_mru (window->display, window);
+
   window->attached = meta_window_should_attach_to_parent (window);
   if (window->attached)
     meta_window_recalc_features (window);
@@ -1287,6 +1292,8 @@ meta_window_unmanage (MetaWindow  *window,
   meta_display_unregister_stamp (window->display, window->stamp);
 
   window->unmanaging = TRUE;
+  meta_display_remove_window_mru (window->display, window);
+  meta_display_remove_window_from_index (window->display, window);
 
   if (meta_prefs_get_attach_modal_dialogs ())
     {
@@ -1424,7 +1431,7 @@ meta_window_unmanage (MetaWindow  *window,
   META_WINDOW_GET_CLASS (window)->unmanage (window);
 
   meta_prefs_remove_listener (prefs_changed_callback, window);
-  meta_screen_queue_check_fullscreen (window->screen);
+  meta_screen_queue_check_fullscreen_for_window (window->screen, window);
 
   g_signal_emit (window, window_signals[UNMANAGED], 0);
 
@@ -1622,8 +1629,13 @@ idle_calc_showing (gpointer data)
   GSList *should_show;
   GSList *should_hide;
   GSList *unplaced;
-  GSList *displays;
+  GSList *screens;
+  MetaDisplay *display;
   guint queue_index = GPOINTER_TO_INT (data);
+#ifdef WITH_VERBOSE_MODE
+  gint64 start_time = g_get_monotonic_time ();
+  guint n_windows = 0;
+#endif
 
   g_return_val_if_fail (queue_pending[queue_index] != NULL, FALSE);
 
@@ -1649,7 +1661,7 @@ idle_calc_showing (gpointer data)
   should_show = NULL;
   should_hide = NULL;
   unplaced = NULL;
-  displays = NULL;
+  screens = NULL;
 
   tmp = copy;
   while (tmp != NULL)
@@ -1658,6 +1670,13 @@ idle_calc_showing (gpointer data)
 
       window = tmp->data;
 
+      if (!g_slist_find (screens, window->screen))
+        screens = g_slist_prepend (screens, window->screen);
+
+#ifdef WITH_VERBOSE_MODE
+      n_windows++;
+#endif
+
       if (!window->placed)
         unplaced = g_slist_prepend (unplaced, window);
       else if (meta_window_should_be_showing (window))
@@ -1675,6 +1694,18 @@ idle_calc_showing (gpointer data)
   should_show = g_slist_sort (should_show, stackcmp);
   should_show = g_slist_reverse (should_show);
 
+  /* Showing or hiding a window thaws the stack, which resyncs the whole
+   * stack to the server; on a workspace switch that happens for every
+   * window. Keep the stacks frozen and the X requests under a single
+   * error trap for the whole batch, so the stack is synced and the
+   * map/unmap requests are flushed once at the end.
+   */
+  display = ((MetaWindow *) copy->data)->display;
+  meta_error_trap_push (display);
+
+  for (tmp = screens; tmp != NULL; tmp = tmp->next)
+    meta_stack_freeze (((MetaScreen *) tmp->data)->stack);
+
   tmp = unplaced;
   while (tmp != NULL)
     {
@@ -1711,6 +1742,12 @@ idle_calc_showing (gpointer data)
       tmp = tmp->next;
     }
 
+  for (tmp = screens; tmp != NULL; tmp = tmp->next)
+    meta_stack_thaw (((MetaScreen *) tmp->data)->stack);
+
+  meta_error_trap_pop (display);
+  XFlush (display->xdisplay);
+
   tmp = copy;
   while (tmp != NULL)
     {
@@ -1752,10 +1789,14 @@ idle_calc_showing (gpointer data)
   g_slist_free (unplaced);
   g_slist_free (should_show);
   g_slist_free (should_hide);
-  g_slist_free (displays);
+  g_slist_free (screens);
 
   destroying_windows_disallowed -= 1;
 
+  meta_topic (META_DEBUG_WINDOW_STATE,
+              "Cleared the calc_showing queue of %u windows in %" G_GINT64_FORMAT " us\n",
+              n_windows, g_get_monotonic_time () - start_time);
+
   return FALSE;
 }
 
@@ -2406,7 +2447,7 @@ meta_window_show (MetaWindow *window)
     }
 
   if (did_show)
-    meta_screen_queue_check_fullscreen (window->screen);
+    meta_screen_queue_check_fullscreen_for_window (window->screen, window);
 
 #ifdef HAVE_WAYLAND
   if (did_show && window->client_type == META_WINDOW_CLIENT_TYPE_WAYLAND)
@@ -2513,7 +2554,7 @@ meta_window_hide (MetaWindow *window)
     }
 
   if (did_hide)
-    meta_screen_queue_check_fullscreen (window->screen);
+    meta_screen_queue_check_fullscreen_for_window (window->screen, window);
 }
 
 static gboolean
@@ -2661,8 +2702,7 @@ meta_window_maximize_internal (MetaWindow        *window,
   meta_window_recalc_features (window);
   set_net_wm_state (window);
 
-  if (window->monitor->in_fullscreen)
-    meta_screen_queue_check_fullscreen (window->screen);
+  meta_screen_queue_check_fullscreen_for_window (window->screen, window);
 
   g_object_freeze_notify (G_OBJECT (window));
   g_object_notify_by_pspec (G_OBJECT (window), obj_props[PROP_MAXIMIZED_HORIZONTALLY]);
@@ -3107,8 +3147,7 @@ meta_window_unmaximize (MetaWindow        *window,
 
       meta_window_recalc_features (window);
       set_net_wm_state (window);
-      if (!window->monitor->in_fullscreen)
-        meta_screen_queue_check_fullscreen (window->screen);
+      meta_screen_queue_check_fullscreen_for_window (window->screen, window);
     }
 
   g_object_freeze_notify (G_OBJECT (window));
@@ -3182,7 +3221,7 @@ meta_window_make_fullscreen_internal (MetaWindow  *window)
       set_net_wm_state (window);
 
       /* For the auto-minimize feature, if we fail to get focus */
-      meta_screen_queue_check_fullscreen (window->screen);
+      meta_screen_queue_check_fullscreen_for_window (window->screen, window);
 
       g_object_notify_by_pspec (G_OBJECT (window), obj_props[PROP_FULLSCREEN]);
     }
@@ -3602,6 +3641,8 @@ meta_window_update_monitor (MetaWindow *window,
       /* If we're changing monitors, we need to update the has_maximize_func flag,
        * as the working area has changed. */
       meta_window_recalc_features (window);
+
+      meta_screen_queue_check_fullscreen_for_window (window->screen, window);
     }
 }
 
@@ -3854,7 +3895,7 @@ meta_window_move_to_monitor (MetaWindow  *window,
   window->preferred_output_winsys_id = window->monitor->winsys_id;
 
   if (window->fullscreen || window->override_redirect)
-    meta_screen_queue_check_fullscreen (window->screen);
+    meta_screen_queue_check_fullscreen_for_window (window->screen, window);
 }
 
 void
@@ -5450,58 +5491,63 @@ meta_window_titlebar_is_onscreen (MetaWindow *window)
   return is_onscreen;
 }
 
-static double
-timeval_to_ms (const GTimeVal *timeval)
-{
-  return (timeval->tv_sec * G_USEC_PER_SEC + timeval->tv_usec) / 1000.0;
-}
-
-static double
-time_diff (const GTimeVal *first,
-	   const GTimeVal *second)
-{
-  double first_ms = timeval_to_ms (first);
-  double second_ms = timeval_to_ms (second);
-
-  return first_ms - second_ms;
-}
-
 static gboolean
-check_moveresize_frequency (MetaWindow *window,
-			    gdouble    *remaining)
+grab_motion_later_func (gpointer data)
 {
-  GTimeVal current_time;
-  const double max_resizes_per_second = 25.0;
-  const double ms_between_resizes = 1000.0 / max_resizes_per_second;
-  double elapsed;
+  MetaWindow *window = data;
+  MetaDisplay *display = window->display;
 
-  g_get_current_time (&current_time);
+  display->grab_motion_later = 0;
 
-  /* If we are throttling via _NET_WM_SYNC_REQUEST, we don't need
-   * an artificial timeout-based throttled */
-  if (!window->disable_sync &&
-      window->sync_request_alarm != None)
-    return TRUE;
+  if (window != display->grab_window)
+    return FALSE;
 
-  elapsed = time_diff (&current_time, &window->display->grab_last_moveresize_time);
+  meta_topic (META_DEBUG_RESIZING,
+              "Applying grab motion to %d,%d %g ms after it arrived\n",
+              display->grab_latest_motion_x,
+              display->grab_latest_motion_y,
+              (g_get_monotonic_time () - display->grab_pending_motion_time) / 1000.0);
+
+  if (meta_grab_op_is_moving (display->grab_op))
+    update_move (window,
+                 display->grab_pending_motion_snap,
+                 display->grab_latest_motion_x,
+                 display->grab_latest_motion_y);
+  else if (meta_grab_op_is_resizing (display->grab_op))
+    update_resize (window,
+                   display->grab_pending_motion_snap,
+                   display->grab_latest_motion_x,
+                   display->grab_latest_motion_y);
 
-  if (elapsed >= 0.0 && elapsed < ms_between_resizes)
-    {
-      meta_topic (META_DEBUG_RESIZING,
-                  "Delaying move/resize as only %g of %g ms elapsed\n",
-                  elapsed, ms_between_resizes);
+  return FALSE;
+}
 
-      if (remaining)
-        *remaining = (ms_between_resizes - elapsed);
+/* Pointer motion during a move/resize grab can arrive much faster than
+ * we can usefully show it.  Rather than moving the window on each event,
+ * remember the latest position and apply it once per frame, right before
+ * the stage is laid out and painted; the frame clock then paces us at the
+ * refresh rate of the display.
+ */
+static void
+queue_grab_motion (MetaWindow *window,
+                   gboolean    snap,
+                   int         x,
+                   int         y)
+{
+  MetaDisplay *display = window->display;
 
-      return FALSE;
-    }
+  display->grab_latest_motion_x = x;
+  display->grab_latest_motion_y = y;
+  display->grab_pending_motion_snap = snap;
 
-  meta_topic (META_DEBUG_RESIZING,
-              " Checked moveresize freq, allowing move/resize now (%g of %g seconds elapsed)\n",
-              elapsed / 1000.0, 1.0 / max_resizes_per_second);
+  if (display->grab_motion_later != 0)
+    return;
 
-  return TRUE;
+  display->grab_pending_motion_time = g_get_monotonic_time ();
+  display->grab_motion_later = meta_later_add (META_LATER_BEFORE_REDRAW,
+                                               grab_motion_later_func,
+                                               window,
+                                               NULL);
 }
 
 static gboolean
@@ -5743,22 +5789,19 @@ update_resize_timeout (gpointer data)
   update_resize (window,
                  window->display->grab_last_user_action_was_snap,
                  window->display->grab_latest_motion_x,
-                 window->display->grab_latest_motion_y,
-                 TRUE);
+                 window->display->grab_latest_motion_y);
   return FALSE;
 }
 
 static void
 update_resize (MetaWindow *window,
                gboolean    snap,
-               int x, int y,
-               gboolean force)
+               int x, int y)
 {
   int dx, dy;
   int new_w, new_h;
   int gravity;
   MetaRectangle old;
-  double remaining = 0;
 
   window->display->grab_latest_motion_x = x;
   window->display->grab_latest_motion_y = y;
@@ -5822,31 +5865,6 @@ update_resize (MetaWindow *window,
   if (window->sync_request_timeout_id != 0)
     return;
 
-  if (!check_moveresize_frequency (window, &remaining) && !force)
-    {
-      /* we are ignoring an event here, so we schedule a
-       * compensation event when we would otherwise not ignore
-       * an event. Otherwise we can become stuck if the user never
-       * generates another event.
-       */
-      if (!window->display->grab_resize_timeout_id)
-	{
-	  window->display->grab_resize_timeout_id =
-	    g_timeout_add ((int)remaining, update_resize_timeout, window);
-	  g_source_set_name_by_id (window->display->grab_resize_timeout_id,
-                                   "[mutter] update_resize_timeout");
-	}
-
-      return;
-    }
-
-  /* Remove any scheduled compensation events */
-  if (window->display->grab_resize_timeout_id)
-    {
-      g_source_remove (window->display->grab_resize_timeout_id);
-      window->display->grab_resize_timeout_id = 0;
-    }
-
   meta_window_get_frame_rect (window, &old);
 
   /* One sided resizing ought to actually be one-sided, despite the fact that
@@ -5874,10 +5892,6 @@ update_resize (MetaWindow *window,
                                           FALSE);
 
   meta_window_resize_frame_with_gravity (window, TRUE, new_w, new_h, gravity);
-
-  /* Store the latest resize time, if we actually resized. */
-  if (window->rect.width != old.width || window->rect.height != old.height)
-    g_get_current_time (&window->display->grab_last_moveresize_time);
 }
 
 static void
@@ -5900,10 +5914,9 @@ update_tile_mode (MetaWindow *window)
 void
 meta_window_update_resize (MetaWindow *window,
                            gboolean    snap,
-                           int x, int y,
-                           gboolean force)
+                           int x, int y)
 {
-  update_resize (window, snap, x, y, force);
+  update_resize (window, snap, x, y);
 }
 
 static void
@@ -5938,8 +5951,7 @@ end_grab_op (MetaWindow *window,
         {
           update_resize (window,
                          modifiers & CLUTTER_SHIFT_MASK,
-                         x, y,
-                         TRUE);
+                         x, y);
 
           /* If a tiled window has been dragged free with a
            * mouse resize without snapping back to the tiled
@@ -6012,19 +6024,9 @@ meta_window_handle_mouse_grab_op_event  (MetaWindow         *window,
       clutter_event_get_coords (event, &x, &y);
 
       meta_display_check_threshold_reached (window->display, x, y);
-      if (meta_grab_op_is_moving (window->display->grab_op))
-        {
-          update_move (window,
-                       modifier_state & CLUTTER_SHIFT_MASK,
-                       x, y);
-        }
-      else if (meta_grab_op_is_resizing (window->display->grab_op))
-        {
-          update_resize (window,
+      queue_grab_motion (window,
                          modifier_state & CLUTTER_SHIFT_MASK,
-                         x, y,
-                         FALSE);
-        }
+                         x, y);
       return TRUE;
 
     default:
@@ -6571,6 +6573,9 @@ meta_window_set_user_time (MetaWindow *window,
       if (XSERVER_TIME_IS_BEFORE (window->display->last_user_time, timestamp))
         window->display->last_user_time = timestamp;
 
+      if (window->display_mru_link != NULL)
+        meta_display_update_window_mru (window->display, window);
+
       /* If this is a terminal, user interaction with it means the user likely
        * doesn't want to have focus transferred for now due to new windows.
        */
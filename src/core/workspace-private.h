@@ -34,6 +34,8 @@
 #include <meta/workspace.h>
 #include "window-private.h"
 
+typedef struct _MetaWorkAreaData MetaWorkAreaData;
+
 struct _MetaWorkspace
 {
   GObject parent_instance;
@@ -54,6 +56,10 @@ struct _MetaWorkspace
 
   GList  *list_containing_self;
 
+  /* The work areas, regions and edges below are owned by work_area_data,
+   * which may be shared with other workspaces that have the same struts.
+   */
+  MetaWorkAreaData *work_area_data;
   MetaRectangle work_area_screen;
   MetaRectangle *work_area_monitor;
   GList  *screen_region;
@@ -53,6 +53,9 @@ static void focus_ancestor_or_top_window (MetaWorkspace *workspace,
                                           guint32        timestamp);
 static void free_this                    (gpointer candidate,
                                           gpointer dummy);
+static gboolean strut_lists_equal        (GSList        *l,
+                                          GSList        *m);
+static void workspace_release_work_areas (MetaWorkspace *workspace);
 
 G_DEFINE_TYPE (MetaWorkspace, meta_workspace, G_TYPE_OBJECT);
 
@@ -181,6 +184,7 @@ meta_workspace_new (MetaScreen *screen)
   workspace->mru_list = NULL;
 
   workspace->work_areas_invalid = TRUE;
+  workspace->work_area_data = NULL;
   workspace->work_area_monitor = NULL;
   workspace->work_area_screen.x = 0;
   workspace->work_area_screen.y = 0;
@@ -265,20 +269,13 @@ assert_workspace_empty (MetaWorkspace *workspace)
 void
 meta_workspace_remove (MetaWorkspace *workspace)
 {
-  MetaScreen *screen;
-  int i;
-
   g_return_if_fail (workspace != workspace->screen->active_workspace);
 
   assert_workspace_empty (workspace);
 
-  screen = workspace->screen;
-
   workspace->screen->workspaces =
     g_list_remove (workspace->screen->workspaces, workspace);
 
-  g_free (workspace->work_area_monitor);
-
   g_list_free (workspace->mru_list);
   g_list_free (workspace->list_containing_self);
 
@@ -294,12 +291,7 @@ meta_workspace_remove (MetaWorkspace *workspace)
   if (!workspace->work_areas_invalid)
     {
       workspace_free_all_struts (workspace);
-      for (i = 0; i < screen->n_monitor_infos; i++)
-        meta_rectangle_free_list_and_elements (workspace->monitor_region[i]);
-      g_free (workspace->monitor_region);
-      meta_rectangle_free_list_and_elements (workspace->screen_region);
-      meta_rectangle_free_list_and_elements (workspace->screen_edges);
-      meta_rectangle_free_list_and_elements (workspace->monitor_edges);
+      workspace_release_work_areas (workspace);
     }
 
   g_object_unref (workspace);
@@ -486,9 +478,10 @@ meta_workspace_activate_with_focus (MetaWorkspace *workspace,
   if (workspace->screen->active_workspace == workspace)
     return;
 
-  /* Free any cached pointers to the workspaces's edges from
-   * a current resize or move operation */
+  /* Free any cached pointers to the workspaces's edges and regions
+   * from a current resize or move operation */
   meta_display_cleanup_edges (workspace->screen->display);
+  meta_display_cleanup_constraint_cache (workspace->screen->display);
 
   if (workspace->screen->active_workspace)
     workspace_switch_sound (workspace->screen->active_workspace, workspace);
@@ -680,7 +673,6 @@ void
 meta_workspace_invalidate_work_area (MetaWorkspace *workspace)
 {
   GList *windows, *l;
-  int i;
 
   if (workspace->work_areas_invalid)
     {
@@ -695,25 +687,16 @@ meta_workspace_invalidate_work_area (MetaWorkspace *workspace)
               meta_workspace_index (workspace));
 
   /* If we are in the middle of a resize or move operation, we
-   * might have cached pointers to the workspace's edges */
+   * might have cached pointers to the workspace's edges; the window
+   * edges are unaffected by the work area, so keep those around. */
   if (workspace == workspace->screen->active_workspace)
-    meta_display_cleanup_edges (workspace->screen->display);
+    meta_display_invalidate_workspace_edges (workspace->screen->display);
 
-  g_free (workspace->work_area_monitor);
-  workspace->work_area_monitor = NULL;
+  /* The grab window's work area may depend on any workspace it is on */
+  meta_display_cleanup_constraint_cache (workspace->screen->display);
 
   workspace_free_all_struts (workspace);
-
-  for (i = 0; i < workspace->screen->n_monitor_infos; i++)
-    meta_rectangle_free_list_and_elements (workspace->monitor_region[i]);
-  g_free (workspace->monitor_region);
-  meta_rectangle_free_list_and_elements (workspace->screen_region);
-  meta_rectangle_free_list_and_elements (workspace->screen_edges);
-  meta_rectangle_free_list_and_elements (workspace->monitor_edges);
-  workspace->monitor_region = NULL;
-  workspace->screen_region = NULL;
-  workspace->screen_edges = NULL;
-  workspace->monitor_edges = NULL;
+  workspace_release_work_areas (workspace);
 
   workspace->work_areas_invalid = TRUE;
 
@@ -748,13 +731,169 @@ copy_strut_list(GSList *original)
   return g_slist_reverse (result);
 }
 
+/* The work areas, spanning rectangles and edges computed from a set of
+ * struts on a given monitor layout.  Panels and docks usually are on all
+ * workspaces, so most workspaces end up with exactly the same struts; the
+ * computed data is interned by strut set and shared (refcounted) between
+ * them, so each distinct configuration only gets computed once.
+ */
+struct _MetaWorkAreaData
+{
+  int            ref_count;
+
+  /* The key: a fingerprint of the struts, plus the struts themselves (in
+   * canonical order) and the monitor layout they were computed for.
+   */
+  guint          fingerprint;
+  GSList        *struts;
+  MetaRectangle  screen_rect;
+  int            n_monitors;
+  MetaRectangle *monitor_rects;
+
+  MetaRectangle  work_area_screen;
+  MetaRectangle *work_area_monitor;
+  GList         *screen_region;
+  GList        **monitor_region;
+  GList         *screen_edges;
+  GList         *monitor_edges;
+};
+
+static GList *interned_work_areas = NULL;
+
+static int
+compare_struts (gconstpointer a,
+                gconstpointer b)
+{
+  const MetaStrut *a_strut = a;
+  const MetaStrut *b_strut = b;
+
+  if (a_strut->side != b_strut->side)
+    return a_strut->side - b_strut->side;
+  if (a_strut->rect.x != b_strut->rect.x)
+    return a_strut->rect.x - b_strut->rect.x;
+  if (a_strut->rect.y != b_strut->rect.y)
+    return a_strut->rect.y - b_strut->rect.y;
+  if (a_strut->rect.width != b_strut->rect.width)
+    return a_strut->rect.width - b_strut->rect.width;
+  return a_strut->rect.height - b_strut->rect.height;
+}
+
+static guint
+struts_fingerprint (GSList *struts)
+{
+  guint hash = 0;
+
+  for (; struts != NULL; struts = struts->next)
+    {
+      MetaStrut *strut = struts->data;
+
+      hash = hash * 31 + strut->side;
+      hash = hash * 31 + strut->rect.x;
+      hash = hash * 31 + strut->rect.y;
+      hash = hash * 31 + strut->rect.width;
+      hash = hash * 31 + strut->rect.height;
+    }
+
+  return hash;
+}
+
+static MetaWorkAreaData *
+lookup_work_area_data (MetaScreen *screen,
+                       GSList     *struts,
+                       guint       fingerprint)
+{
+  GList *l;
+  int i;
+
+  for (l = interned_work_areas; l != NULL; l = l->next)
+    {
+      MetaWorkAreaData *data = l->data;
+
+      if (data->fingerprint != fingerprint ||
+          data->n_monitors != screen->n_monitor_infos ||
+          !meta_rectangle_equal (&data->screen_rect, &screen->rect))
+        continue;
+
+      for (i = 0; i < data->n_monitors; i++)
+        if (!meta_rectangle_equal (&data->monitor_rects[i],
+                                   &screen->monitor_infos[i].rect))
+          break;
+
+      if (i == data->n_monitors && strut_lists_equal (data->struts, struts))
+        return data;
+    }
+
+  return NULL;
+}
+
+static void
+work_area_data_unref (MetaWorkAreaData *data)
+{
+  int i;
+
+  if (--data->ref_count > 0)
+    return;
+
+  interned_work_areas = g_list_remove (interned_work_areas, data);
+
+  g_slist_foreach (data->struts, free_this, NULL);
+  g_slist_free (data->struts);
+  g_free (data->monitor_rects);
+  g_free (data->work_area_monitor);
+  for (i = 0; i < data->n_monitors; i++)
+    meta_rectangle_free_list_and_elements (data->monitor_region[i]);
+  g_free (data->monitor_region);
+  meta_rectangle_free_list_and_elements (data->screen_region);
+  meta_rectangle_free_list_and_elements (data->screen_edges);
+  meta_rectangle_free_list_and_elements (data->monitor_edges);
+  g_slice_free (MetaWorkAreaData, data);
+}
+
+static void
+workspace_use_work_area_data (MetaWorkspace    *workspace,
+                              MetaWorkAreaData *data)
+{
+  data->ref_count++;
+
+  workspace->work_area_data = data;
+  workspace->work_area_screen = data->work_area_screen;
+  workspace->work_area_monitor = data->work_area_monitor;
+  workspace->screen_region = data->screen_region;
+  workspace->monitor_region = data->monitor_region;
+  workspace->screen_edges = data->screen_edges;
+  workspace->monitor_edges = data->monitor_edges;
+}
+
+/**
+ * workspace_release_work_areas:
+ * @workspace: The workspace.
+ *
+ * Drops the workspace's reference on its (possibly shared) work areas,
+ * regions and edges.
+ */
+static void
+workspace_release_work_areas (MetaWorkspace *workspace)
+{
+  if (workspace->work_area_data)
+    work_area_data_unref (workspace->work_area_data);
+
+  workspace->work_area_data = NULL;
+  workspace->work_area_monitor = NULL;
+  workspace->monitor_region = NULL;
+  workspace->screen_region = NULL;
+  workspace->screen_edges = NULL;
+  workspace->monitor_edges = NULL;
+}
+
 static void
 ensure_work_areas_validated (MetaWorkspace *workspace)
 {
-  GList         *windows;
-  GList         *tmp;
-  MetaRectangle  work_area;
-  int            i;  /* C89 absolutely sucks... */
+  GList            *windows;
+  GList            *tmp;
+  MetaRectangle     work_area;
+  MetaWorkAreaData *data;
+  guint             fingerprint;
+  int               i;  /* C89 absolutely sucks... */
 
   if (!workspace->work_areas_invalid)
     return;
@@ -782,6 +921,26 @@ ensure_work_areas_validated (MetaWorkspace *workspace)
     }
   g_list_free (windows);
 
+  /* Put the struts in canonical order so workspaces with the same struts
+   * can share the results below.
+   */
+  workspace->all_struts = g_slist_sort (workspace->all_struts, compare_struts);
+  fingerprint = struts_fingerprint (workspace->all_struts);
+
+  data = lookup_work_area_data (workspace->screen,
+                                workspace->all_struts,
+                                fingerprint);
+  if (data)
+    {
+      meta_topic (META_DEBUG_WORKAREA,
+                  "Sharing already computed work areas with workspace %d\n",
+                  meta_workspace_index (workspace));
+
+      workspace_use_work_area_data (workspace, data);
+      workspace->work_areas_invalid = FALSE;
+      return;
+    }
+
   /* STEP 2: Get the maximal/spanning rects for the onscreen and
    *         on-single-monitor regions
    */
@@ -859,7 +1018,6 @@ ensure_work_areas_validated (MetaWorkspace *workspace)
               workspace->work_area_screen.height);
 
   /* Now find the work areas for each monitor */
-  g_free (workspace->work_area_monitor);
   workspace->work_area_monitor = g_new (MetaRectangle,
                                          workspace->screen->n_monitor_infos);
 
@@ -914,6 +1072,27 @@ ensure_work_areas_validated (MetaWorkspace *workspace)
                                                        workspace->all_struts);
   g_list_free (tmp);
 
+  /* STEP 6: Intern the results so that other workspaces with the same
+   *         struts can share them.
+   */
+  data = g_slice_new0 (MetaWorkAreaData);
+  data->fingerprint = fingerprint;
+  data->struts = copy_strut_list (workspace->all_struts);
+  data->screen_rect = workspace->screen->rect;
+  data->n_monitors = workspace->screen->n_monitor_infos;
+  data->monitor_rects = g_new (MetaRectangle, data->n_monitors);
+  for (i = 0; i < data->n_monitors; i++)
+    data->monitor_rects[i] = workspace->screen->monitor_infos[i].rect;
+  data->work_area_screen = workspace->work_area_screen;
+  data->work_area_monitor = workspace->work_area_monitor;
+  data->screen_region = workspace->screen_region;
+  data->monitor_region = workspace->monitor_region;
+  data->screen_edges = workspace->screen_edges;
+  data->monitor_edges = workspace->monitor_edges;
+  interned_work_areas = g_list_prepend (interned_work_areas, data);
+
+  workspace_use_work_area_data (workspace, data);
+
   /* We're all done, YAAY!  Record that everything has been validated. */
   workspace->work_areas_invalid = FALSE;
 }
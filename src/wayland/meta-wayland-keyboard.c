@@ -129,75 +129,158 @@ inform_clients_of_new_keymap (MetaWaylandKeyboard *keyboard)
     }
 }
 
+/* Number of serialized keymaps kept, matching the backend keymap cache so
+ * that toggling between layouts just resends an existing file */
+#define KEYMAP_FILE_CACHE_SIZE 4
+
+typedef struct
+{
+  struct xkb_keymap *keymap;
+  int fd;
+  size_t size;
+} MetaWaylandKeymapFile;
+
 static void
-meta_wayland_keyboard_take_keymap (MetaWaylandKeyboard *keyboard,
-				   struct xkb_keymap   *keymap)
+keymap_file_free (MetaWaylandKeymapFile *file)
 {
-  MetaWaylandXkbInfo  *xkb_info = &keyboard->xkb_info;
-  GError *error = NULL;
-  char *keymap_str;
-  size_t previous_size;
+  xkb_keymap_unref (file->keymap);
+  close (file->fd);
+  g_slice_free (MetaWaylandKeymapFile, file);
+}
 
-  if (keymap == NULL)
+static int
+create_keymap_fd (const char  *keymap_str,
+                  size_t       size,
+                  GError     **error)
+{
+  int fd;
+
+#ifdef MFD_ALLOW_SEALING
+  fd = memfd_create ("mutter-keymap", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd >= 0)
     {
-      g_warning ("Attempting to set null keymap (compilation probably failed)");
-      return;
+      if (write (fd, keymap_str, size) != (ssize_t) size)
+        {
+          g_set_error_literal (error,
+                               G_FILE_ERROR,
+                               g_file_error_from_errno (errno),
+                               strerror (errno));
+          close (fd);
+          return -1;
+        }
+
+      /* The same file is handed to every client; seal its size so that
+       * none of them can truncate it under the others. It isn't write
+       * sealed, as clients before wl_keyboard version 7 may map it
+       * MAP_SHARED, which older kernels refuse for write-sealed files. */
+      fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+      return fd;
     }
+#endif
 
-  xkb_keymap_unref (xkb_info->keymap);
-  xkb_info->keymap = xkb_keymap_ref (keymap);
+  fd = create_anonymous_file (size, error);
+  if (fd < 0)
+    return -1;
 
-  meta_wayland_keyboard_update_xkb_state (keyboard);
+  if (pwrite (fd, keymap_str, size, 0) != (ssize_t) size)
+    {
+      g_set_error_literal (error,
+                           G_FILE_ERROR,
+                           g_file_error_from_errno (errno),
+                           strerror (errno));
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+static MetaWaylandKeymapFile *
+ensure_keymap_file (MetaWaylandXkbInfo *xkb_info)
+{
+  MetaWaylandKeymapFile *file;
+  GError *error = NULL;
+  char *keymap_str;
+  size_t size;
+  int fd;
+  GList *l;
+
+  for (l = xkb_info->keymap_files.head; l; l = l->next)
+    {
+      file = l->data;
+
+      if (file->keymap == xkb_info->keymap)
+        {
+          g_queue_unlink (&xkb_info->keymap_files, l);
+          g_queue_push_head_link (&xkb_info->keymap_files, l);
+          return file;
+        }
+    }
 
   keymap_str = xkb_map_get_as_string (xkb_info->keymap);
   if (keymap_str == NULL)
     {
       g_warning ("failed to get string version of keymap");
-      return;
+      return NULL;
     }
-  previous_size = xkb_info->keymap_size;
-  xkb_info->keymap_size = strlen (keymap_str) + 1;
+  size = strlen (keymap_str) + 1;
 
-  if (xkb_info->keymap_fd >= 0)
-    close (xkb_info->keymap_fd);
+  fd = create_keymap_fd (keymap_str, size, &error);
+  free (keymap_str);
 
-  xkb_info->keymap_fd = create_anonymous_file (xkb_info->keymap_size, &error);
-  if (xkb_info->keymap_fd < 0)
+  if (fd < 0)
     {
       g_warning ("creating a keymap file for %lu bytes failed: %s",
-                 (unsigned long) xkb_info->keymap_size,
+                 (unsigned long) size,
                  error->message);
       g_clear_error (&error);
-      goto err_keymap_str;
+      return NULL;
     }
 
-  if (xkb_info->keymap_area)
-    munmap (xkb_info->keymap_area, previous_size);
+  file = g_slice_new (MetaWaylandKeymapFile);
+  file->keymap = xkb_keymap_ref (xkb_info->keymap);
+  file->fd = fd;
+  file->size = size;
+  g_queue_push_head (&xkb_info->keymap_files, file);
 
-  xkb_info->keymap_area = mmap (NULL, xkb_info->keymap_size,
-                                PROT_READ | PROT_WRITE,
-                                MAP_SHARED, xkb_info->keymap_fd, 0);
-  if (xkb_info->keymap_area == MAP_FAILED)
+  while (xkb_info->keymap_files.length > KEYMAP_FILE_CACHE_SIZE)
+    keymap_file_free (g_queue_pop_tail (&xkb_info->keymap_files));
+
+  return file;
+}
+
+static void
+meta_wayland_keyboard_take_keymap (MetaWaylandKeyboard *keyboard,
+				   struct xkb_keymap   *keymap)
+{
+  MetaWaylandXkbInfo  *xkb_info = &keyboard->xkb_info;
+  MetaWaylandKeymapFile *file;
+
+  if (keymap == NULL)
     {
-      g_warning ("failed to mmap() %lu bytes\n",
-                 (unsigned long) xkb_info->keymap_size);
-      goto err_dev_zero;
+      g_warning ("Attempting to set null keymap (compilation probably failed)");
+      return;
     }
-  strcpy (xkb_info->keymap_area, keymap_str);
-  free (keymap_str);
 
-  inform_clients_of_new_keymap (keyboard);
+  xkb_keymap_unref (xkb_info->keymap);
+  xkb_info->keymap = xkb_keymap_ref (keymap);
 
-  notify_modifiers (keyboard);
+  meta_wayland_keyboard_update_xkb_state (keyboard);
+
+  file = ensure_keymap_file (xkb_info);
+  if (file == NULL)
+    {
+      xkb_info->keymap_fd = -1;
+      xkb_info->keymap_size = 0;
+      return;
+    }
 
-  return;
+  xkb_info->keymap_fd = file->fd;
+  xkb_info->keymap_size = file->size;
 
-err_dev_zero:
-  close (xkb_info->keymap_fd);
-  xkb_info->keymap_fd = -1;
-err_keymap_str:
-  free (keymap_str);
-  return;
+  inform_clients_of_new_keymap (keyboard);
+
+  notify_modifiers (keyboard);
 }
 
 static void
@@ -402,10 +485,9 @@ meta_wayland_xkb_info_destroy (MetaWaylandXkbInfo *xkb_info)
   xkb_keymap_unref (xkb_info->keymap);
   xkb_state_unref (xkb_info->state);
 
-  if (xkb_info->keymap_area)
-    munmap (xkb_info->keymap_area, xkb_info->keymap_size);
-  if (xkb_info->keymap_fd >= 0)
-    close (xkb_info->keymap_fd);
+  g_queue_foreach (&xkb_info->keymap_files, (GFunc) keymap_file_free, NULL);
+  g_queue_clear (&xkb_info->keymap_files);
+  xkb_info->keymap_fd = -1;
 }
 
 void
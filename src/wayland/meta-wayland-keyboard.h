@@ -55,7 +55,10 @@ typedef struct
   struct xkb_state *state;
   int keymap_fd;
   size_t keymap_size;
-  char *keymap_area;
+
+  /* MetaWaylandKeymapFile, most recently used first; keymap_fd and
+   * keymap_size are those of the head */
+  GQueue keymap_files;
 } MetaWaylandXkbInfo;
 
 struct _MetaWaylandKeyboard
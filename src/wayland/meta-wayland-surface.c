@@ -1277,6 +1277,9 @@ xdg_surface_ack_configure (struct wl_client *client,
 
   surface->acked_configure_serial.set = TRUE;
   surface->acked_configure_serial.value = serial;
+
+  if (surface->window)
+    meta_window_wayland_configure_acked (surface->window, serial);
 }
 
 static void
@@ -44,8 +44,24 @@ struct _MetaWindowWayland
 
   int last_sent_width;
   int last_sent_height;
+
+  /* Flow control for interactive resizes: while a configure sent during the
+   * resize hasn't been acked yet, newer sizes are only remembered and sent
+   * once the client catches up.
+   */
+  MetaWaylandSerial interactive_configure_serial;
+  gint64 interactive_configure_time;
+  gboolean has_pending_interactive_configure;
+  int pending_configure_width;
+  int pending_configure_height;
+  guint interactive_configure_timeout_id;
 };
 
+/* Like the _NET_WM_SYNC_REQUEST timeout for X11 clients, stop waiting for
+ * clients which don't ack a configure within a second.
+ */
+#define INTERACTIVE_CONFIGURE_TIMEOUT_US (1000 * 1000)
+
 struct _MetaWindowWaylandClass
 {
   MetaWindowClass parent_class;
@@ -77,6 +93,18 @@ meta_window_wayland_manage (MetaWindow *window)
     }
 }
 
+static void
+clear_interactive_configure_timeout (MetaWindow *window)
+{
+  MetaWindowWayland *wl_window = META_WINDOW_WAYLAND (window);
+
+  if (wl_window->interactive_configure_timeout_id)
+    {
+      g_source_remove (wl_window->interactive_configure_timeout_id);
+      wl_window->interactive_configure_timeout_id = 0;
+    }
+}
+
 static void
 meta_window_wayland_unmanage (MetaWindow *window)
 {
@@ -87,6 +115,8 @@ meta_window_wayland_unmanage (MetaWindow *window)
   }
 
   meta_display_unregister_wayland_window (window->display, window);
+
+  clear_interactive_configure_timeout (window);
 }
 
 static void
@@ -130,12 +160,132 @@ surface_state_changed (MetaWindow *window)
 {
   MetaWindowWayland *wl_window = META_WINDOW_WAYLAND (window);
 
+  /* last_sent_width/height already are the latest size we wanted to send,
+   * so this takes care of any configure that was held back too.
+   */
+  wl_window->has_pending_interactive_configure = FALSE;
+  wl_window->interactive_configure_serial.set = FALSE;
+  clear_interactive_configure_timeout (window);
+
   meta_wayland_surface_configure_notify (window->surface,
                                          wl_window->last_sent_width,
                                          wl_window->last_sent_height,
                                          &wl_window->pending_configure_serial);
 }
 
+static void send_interactive_configure (MetaWindow *window,
+                                        int         width,
+                                        int         height);
+
+/* The client didn't ack in time; send the size held back since, even if
+ * no further motion comes to do it.
+ */
+static gboolean
+interactive_configure_timeout (gpointer data)
+{
+  MetaWindow *window = data;
+  MetaWindowWayland *wl_window = META_WINDOW_WAYLAND (window);
+
+  wl_window->interactive_configure_timeout_id = 0;
+  wl_window->interactive_configure_serial.set = FALSE;
+
+  meta_topic (META_DEBUG_RESIZING,
+              "%s didn't ack its configure in time, sending %dx%d\n",
+              window->desc,
+              wl_window->pending_configure_width,
+              wl_window->pending_configure_height);
+
+  if (wl_window->has_pending_interactive_configure)
+    send_interactive_configure (window,
+                                wl_window->pending_configure_width,
+                                wl_window->pending_configure_height);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+send_interactive_configure (MetaWindow *window,
+                            int         width,
+                            int         height)
+{
+  MetaWindowWayland *wl_window = META_WINDOW_WAYLAND (window);
+
+  /* Only xdg_surface has configure acks we can wait for */
+  if (!window->surface->xdg_surface)
+    {
+      meta_wayland_surface_configure_notify (window->surface,
+                                             width, height,
+                                             &wl_window->pending_configure_serial);
+      return;
+    }
+
+  if (wl_window->interactive_configure_serial.set &&
+      g_get_monotonic_time () - wl_window->interactive_configure_time <
+      INTERACTIVE_CONFIGURE_TIMEOUT_US)
+    {
+      meta_topic (META_DEBUG_RESIZING,
+                  "Holding back %dx%d configure for %s until the previous one "
+                  "is acked\n",
+                  width, height, window->desc);
+
+      wl_window->has_pending_interactive_configure = TRUE;
+      wl_window->pending_configure_width = width;
+      wl_window->pending_configure_height = height;
+
+      if (!wl_window->interactive_configure_timeout_id)
+        {
+          gint64 remaining_us = INTERACTIVE_CONFIGURE_TIMEOUT_US -
+            (g_get_monotonic_time () - wl_window->interactive_configure_time);
+
+          wl_window->interactive_configure_timeout_id =
+            g_timeout_add (MAX (remaining_us / 1000, 1),
+                           interactive_configure_timeout,
+                           window);
+          g_source_set_name_by_id (wl_window->interactive_configure_timeout_id,
+                                   "[mutter] interactive_configure_timeout");
+        }
+      return;
+    }
+
+  wl_window->has_pending_interactive_configure = FALSE;
+  clear_interactive_configure_timeout (window);
+
+  meta_wayland_surface_configure_notify (window->surface,
+                                         width, height,
+                                         &wl_window->pending_configure_serial);
+
+  wl_window->interactive_configure_serial = wl_window->pending_configure_serial;
+  wl_window->interactive_configure_time = g_get_monotonic_time ();
+}
+
+/**
+ * meta_window_wayland_configure_acked:
+ * @window: a #MetaWindow
+ * @serial: the serial the client acked
+ *
+ * Called when the client acks a configure.  If a size was held back
+ * during an interactive resize because the client was still busy with
+ * the previous one, it gets sent now.
+ */
+void
+meta_window_wayland_configure_acked (MetaWindow *window,
+                                     guint32     serial)
+{
+  MetaWindowWayland *wl_window = META_WINDOW_WAYLAND (window);
+
+  if (!wl_window->interactive_configure_serial.set ||
+      wl_window->interactive_configure_serial.value != serial)
+    return;
+
+  wl_window->interactive_configure_serial.set = FALSE;
+  clear_interactive_configure_timeout (window);
+
+  if (wl_window->has_pending_interactive_configure)
+    send_interactive_configure (window,
+                                wl_window->pending_configure_width,
+                                wl_window->pending_configure_height);
+}
+
 static void
 meta_window_wayland_grab_op_began (MetaWindow *window,
                                    MetaGrabOp  op)
@@ -233,10 +383,16 @@ meta_window_wayland_move_resize_internal (MetaWindow                *window,
               constrained_rect.height == 1)
             return;
 
-          meta_wayland_surface_configure_notify (window->surface,
-                                                 configured_width,
-                                                 configured_height,
-                                                 &wl_window->pending_configure_serial);
+          if (meta_grab_op_is_resizing (window->display->grab_op) &&
+              window == window->display->grab_window)
+            send_interactive_configure (window,
+                                        configured_width,
+                                        configured_height);
+          else
+            meta_wayland_surface_configure_notify (window->surface,
+                                                   configured_width,
+                                                   configured_height,
+                                                   &wl_window->pending_configure_serial);
 
           /* We need to wait until the resize completes before we can move */
           can_move_now = FALSE;
@@ -34,7 +34,9 @@
 #include "workspace-private.h"
 
 #include "x11/window-x11.h"
+#include "x11/window-props.h"
 #include "x11/xprops.h"
+#include "x11/roundtrip-audit.h"
 
 #ifdef HAVE_WAYLAND
 #include "wayland/meta-xwayland.h"
@@ -1012,7 +1014,7 @@ convert_property (MetaDisplay *display,
 		     (unsigned char *)icccm_version, 2);
   else
     {
-      meta_error_trap_pop_with_return (display);
+      meta_error_trap_pop (display);
       return FALSE;
     }
 
@@ -1024,7 +1026,7 @@ convert_property (MetaDisplay *display,
    */
   /* FIXME the error trap pop synced anyway, right? */
   meta_topic (META_DEBUG_SYNC, "Syncing on %s\n", G_STRFUNC);
-  XSync (display->xdisplay, False);
+  META_X_ROUNDTRIP ("XSync", XSync (display->xdisplay, False));
 
   return TRUE;
 }
@@ -1079,7 +1081,7 @@ process_selection_request (MetaDisplay   *display,
                                   display->atom_ATOM_PAIR,
                                   &type, &format, &num, &rest, &data) != Success)
             {
-              meta_error_trap_pop_with_return (display);
+              meta_error_trap_pop (display);
               return;
             }
 
@@ -1688,6 +1690,12 @@ meta_display_handle_xevent (MetaDisplay *display,
     }
 #endif
 
+  /* Property reloads are coalesced over runs of PropertyNotify events;
+   * anything else may depend on their outcome, so run them first.
+   */
+  if (event->type != PropertyNotify)
+    meta_display_flush_property_reloads (display);
+
   display->current_time = event_get_time (display, event);
   display->monitor_cache_invalidated = TRUE;
 
@@ -1776,6 +1784,94 @@ meta_display_handle_xevent (MetaDisplay *display,
 }
 
 
+static gboolean
+configure_event_supersedes (XEvent *event,
+                            XEvent *next)
+{
+  return (next->type == ConfigureNotify &&
+          !event->xany.send_event &&
+          !next->xany.send_event &&
+          next->xconfigure.event == event->xconfigure.event &&
+          next->xconfigure.window == event->xconfigure.window);
+}
+
+static gboolean
+damage_event_merges (MetaDisplay *display,
+                     XEvent      *event,
+                     XEvent      *next)
+{
+  return (next->type == display->damage_event_base + XDamageNotify &&
+          ((XDamageNotifyEvent *) next)->damage ==
+          ((XDamageNotifyEvent *) event)->damage);
+}
+
+static void
+merge_damage_area (XDamageNotifyEvent *event,
+                   XDamageNotifyEvent *next)
+{
+  int x1 = MIN (event->area.x, next->area.x);
+  int y1 = MIN (event->area.y, next->area.y);
+  int x2 = MAX (event->area.x + event->area.width,
+                next->area.x + next->area.width);
+  int y2 = MAX (event->area.y + event->area.height,
+                next->area.y + next->area.height);
+
+  *event = *next;
+  event->area.x = x1;
+  event->area.y = y1;
+  event->area.width = x2 - x1;
+  event->area.height = y2 - y1;
+}
+
+/* GDK takes events off the Xlib queue one at a time, so whatever is
+ * still queued behind @event hasn't been seen by anyone yet. A run of
+ * ConfigureNotify events for one window only matters for its last
+ * member, and a run of DamageNotify events for one damage object
+ * collapses into the union of their areas; fold such runs into @event
+ * before handling it. Only directly following events are folded, so
+ * the order, and thus the serials, seen by the stack tracker and the
+ * focus logic relative to all other events are unchanged.
+ */
+static void
+compress_xevent (MetaDisplay *display,
+                 XEvent      *event)
+{
+  XEvent next;
+  guint n_folded = 0;
+
+  if (event->type != ConfigureNotify &&
+      event->type != display->damage_event_base + XDamageNotify)
+    return;
+
+  while (XEventsQueued (display->xdisplay, QueuedAlready) > 0)
+    {
+      XPeekEvent (display->xdisplay, &next);
+
+      if (event->type == ConfigureNotify &&
+          configure_event_supersedes (event, &next))
+        *event = next;
+      else if (event->type != ConfigureNotify &&
+               damage_event_merges (display, event, &next))
+        merge_damage_area ((XDamageNotifyEvent *) event,
+                           (XDamageNotifyEvent *) &next);
+      else
+        break;
+
+      XNextEvent (display->xdisplay, &next);
+      n_folded++;
+    }
+
+  display->n_xevents_compressed += n_folded;
+
+  if (n_folded > 0)
+    meta_topic (META_DEBUG_EVENTS,
+                "Folded %u queued %s events into one (%u of %u events folded so far)\n",
+                n_folded,
+                event->type == ConfigureNotify ? "ConfigureNotify" : "DamageNotify",
+                display->n_xevents_compressed,
+                display->n_xevents_received + display->n_xevents_compressed);
+}
+
 static GdkFilterReturn
 xevent_filter (GdkXEvent *xevent,
                GdkEvent  *event,
@@ -1783,6 +1879,9 @@ xevent_filter (GdkXEvent *xevent,
 {
   MetaDisplay *display = data;
 
+  display->n_xevents_received++;
+  compress_xevent (display, xevent);
+
   if (meta_display_handle_xevent (display, xevent))
     return GDK_FILTER_REMOVE;
   else
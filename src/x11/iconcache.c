@@ -29,88 +29,58 @@
 #include <cairo-xlib.h>
 #include <cairo-xlib-xrender.h>
 
+#include <string.h>
+
 #include <X11/Xatom.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/extensions/Xrender.h>
 
-static gboolean
-find_largest_sizes (gulong *data,
-                    gulong  nitems,
-                    int    *width,
-                    int    *height)
+/* One image of a _NET_WM_ICON property: its size, the offset of its
+ * pixels within the property, in 32-bit units, and the pixels if they
+ * were already read along with the header.
+ */
+typedef struct
 {
-  *width = 0;
-  *height = 0;
-
-  while (nitems > 0)
-    {
-      int w, h;
-
-      if (nitems < 3)
-        return FALSE; /* no space for w, h */
-
-      w = data[0];
-      h = data[1];
-
-      if (nitems < ((gulong)(w * h) + 2))
-        return FALSE; /* not enough data */
-
-      *width = MAX (w, *width);
-      *height = MAX (h, *height);
-
-      data += (w * h) + 2;
-      nitems -= (w * h) + 2;
-    }
-
-  return TRUE;
-}
-
-static gboolean
-find_best_size (gulong  *data,
-                gulong   nitems,
-                int      ideal_width,
-                int      ideal_height,
-                int     *width,
-                int     *height,
-                gulong **start)
+  int width;
+  int height;
+  guint32 offset;
+  const uint32_t *pixels;
+} IconImage;
+
+static const IconImage *
+find_best_size (GArray *images,
+                int     ideal_width,
+                int     ideal_height)
 {
-  int best_w;
-  int best_h;
-  gulong *best_start;
+  const IconImage *best;
   int max_width, max_height;
+  guint i;
 
-  *width = 0;
-  *height = 0;
-  *start = NULL;
+  max_width = 0;
+  max_height = 0;
+  for (i = 0; i < images->len; i++)
+    {
+      const IconImage *image = &g_array_index (images, IconImage, i);
 
-  if (!find_largest_sizes (data, nitems, &max_width, &max_height))
-    return FALSE;
+      max_width = MAX (image->width, max_width);
+      max_height = MAX (image->height, max_height);
+    }
 
   if (ideal_width < 0)
     ideal_width = max_width;
   if (ideal_height < 0)
     ideal_height = max_height;
 
-  best_w = 0;
-  best_h = 0;
-  best_start = NULL;
+  best = NULL;
 
-  while (nitems > 0)
+  for (i = 0; i < images->len; i++)
     {
-      int w, h;
+      const IconImage *image = &g_array_index (images, IconImage, i);
       gboolean replace;
 
       replace = FALSE;
 
-      if (nitems < 3)
-        return FALSE; /* no space for w, h */
-
-      w = data[0];
-      h = data[1];
-
-      if (nitems < ((gulong)(w * h) + 2))
-        break; /* not enough data */
-
-      if (best_start == NULL)
+      if (best == NULL)
         {
           replace = TRUE;
         }
@@ -118,8 +88,8 @@ find_best_size (gulong  *data,
         {
           /* work with averages */
           const int ideal_size = (ideal_width + ideal_height) / 2;
-          int best_size = (best_w + best_h) / 2;
-          int this_size = (w + h) / 2;
+          int best_size = (best->width + best->height) / 2;
+          int this_size = (image->width + image->height) / 2;
 
           /* larger than desired is always better than smaller */
           if (best_size < ideal_size &&
@@ -139,49 +109,294 @@ find_best_size (gulong  *data,
         }
 
       if (replace)
-        {
-          best_start = data + 2;
-          best_w = w;
-          best_h = h;
-        }
+        best = image;
+    }
+
+  return best;
+}
+
+/* Decoded icons are shared by content, so that all the windows of an
+ * application that set the same _NET_WM_ICON use the same surfaces.
+ * The cache holds no reference; entries go away with their surface.
+ * Entries keep their own copy of the pixels, since cairo has already
+ * freed the surface's when the entry is removed.
+ */
+typedef struct
+{
+  guint hash;
+  int width;
+  int height;
+  const uint32_t *data;
+  cairo_surface_t *surface;
+} CachedIcon;
+
+static GHashTable *icon_surface_cache = NULL;
+static const cairo_user_data_key_t cached_icon_key;
+
+static guint
+cached_icon_hash (gconstpointer key)
+{
+  const CachedIcon *cached = key;
+
+  return cached->hash;
+}
+
+static gboolean
+cached_icon_equal (gconstpointer a,
+                   gconstpointer b)
+{
+  const CachedIcon *cached_a = a;
+  const CachedIcon *cached_b = b;
+
+  return (cached_a->hash == cached_b->hash &&
+          cached_a->width == cached_b->width &&
+          cached_a->height == cached_b->height &&
+          memcmp (cached_a->data, cached_b->data,
+                  (gsize) cached_a->width * cached_a->height * sizeof (uint32_t)) == 0);
+}
+
+static void
+cached_icon_destroyed (void *data)
+{
+  CachedIcon *cached = data;
+
+  g_hash_table_remove (icon_surface_cache, cached);
+  g_free ((uint32_t *) cached->data);
+  g_free (cached);
+}
+
+static guint
+hash_argb_data (const uint32_t *argb_data,
+                int             w,
+                int             h)
+{
+  gsize i, n_pixels = (gsize) w * h;
+  guint hash = 2166136261u;
+
+  hash = (hash ^ w) * 16777619u;
+  hash = (hash ^ h) * 16777619u;
+  for (i = 0; i < n_pixels; i++)
+    hash = (hash ^ argb_data[i]) * 16777619u;
+
+  return hash;
+}
+
+static cairo_surface_t *
+argbdata_to_surface (const uint32_t *argb_data, int w, int h)
+{
+  cairo_surface_t *surface;
+  CachedIcon lookup, *cached;
+  int y, stride;
+  guchar *data;
+
+  if (icon_surface_cache == NULL)
+    icon_surface_cache = g_hash_table_new (cached_icon_hash, cached_icon_equal);
+
+  lookup.hash = hash_argb_data (argb_data, w, h);
+  lookup.width = w;
+  lookup.height = h;
+  lookup.data = argb_data;
+
+  cached = g_hash_table_lookup (icon_surface_cache, &lookup);
+  if (cached)
+    return cairo_surface_reference (cached->surface);
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, w, h);
+  stride = cairo_image_surface_get_stride (surface);
+  data = cairo_image_surface_get_data (surface);
+
+  for (y = 0; y < h; y++)
+    memcpy (data + y * stride, argb_data + y * w, w * sizeof (uint32_t));
+
+  cairo_surface_mark_dirty (surface);
+
+  cached = g_new (CachedIcon, 1);
+  *cached = lookup;
+  cached->data = g_memdup (argb_data, (gsize) w * h * sizeof (uint32_t));
+  cached->surface = surface;
 
-      data += (w * h) + 2;
-      nitems -= (w * h) + 2;
+  g_hash_table_add (icon_surface_cache, cached);
+  cairo_surface_set_user_data (surface, &cached_icon_key,
+                               cached, cached_icon_destroyed);
+
+  return surface;
+}
+
+/* Amount of _NET_WM_ICON read per request while looking for image
+ * headers, in 32-bit units. Most properties, up to a 128x128 image and
+ * a few smaller ones, fit in the first read entirely.
+ */
+#define ICON_CHUNK_LENGTH (64 * 1024)
+
+/* Read up to ICON_CHUNK_LENGTH values of _NET_WM_ICON from *offset and
+ * parse every image header in them. Images whose pixels are entirely
+ * within the chunk point into the reply, which is kept in @chunks.
+ * *offset is advanced to the first header not covered by the chunk.
+ */
+static gboolean
+read_rgb_icon_chunk (MetaDisplay      *display,
+                     xcb_connection_t *xcb_conn,
+                     Window            xwindow,
+                     guint64          *offset,
+                     guint64          *total_length,
+                     GPtrArray        *chunks,
+                     GArray           *images)
+{
+  xcb_get_property_cookie_t cookie;
+  xcb_get_property_reply_t *reply;
+  xcb_generic_error_t *error = NULL;
+  guint64 n_items, total, chunk_end, pos;
+  uint32_t *values;
+
+  cookie = xcb_get_property (xcb_conn, False, xwindow,
+                             display->atom__NET_WM_ICON,
+                             XA_CARDINAL, *offset, ICON_CHUNK_LENGTH);
+  reply = xcb_get_property_reply (xcb_conn, cookie, &error);
+  if (error)
+    {
+      free (error);
+      return FALSE;
     }
 
-  if (best_start)
+  if (reply == NULL)
+    return FALSE;
+
+  if (reply->type != XA_CARDINAL || reply->format != 32)
     {
-      *start = best_start;
-      *width = best_w;
-      *height = best_h;
-      return TRUE;
+      free (reply);
+      return FALSE;
     }
-  else
+
+  g_ptr_array_add (chunks, reply);
+
+  n_items = xcb_get_property_value_length (reply) / sizeof (uint32_t);
+  total = *offset + n_items + reply->bytes_after / sizeof (uint32_t);
+
+  /* A different length means the property was replaced between our
+   * reads; the PropertyNotify for that will make us read it again.
+   */
+  if (*offset == 0)
+    *total_length = total;
+  else if (total != *total_length || n_items == 0)
     return FALSE;
+
+  values = xcb_get_property_value (reply);
+  chunk_end = *offset + n_items;
+  pos = *offset;
+
+  while (pos < total)
+    {
+      IconImage image;
+      guint64 n_pixels;
+
+      if (total - pos < 3)
+        return FALSE; /* no space for w, h */
+
+      if (pos + 2 > chunk_end)
+        break; /* header is in the next chunk */
+
+      image.width = values[pos - *offset];
+      image.height = values[pos - *offset + 1];
+
+      n_pixels = (guint64) image.width * image.height;
+      if (image.width < 0 || image.height < 0 ||
+          total - pos < n_pixels + 2 ||
+          pos + 2 > G_MAXUINT32)
+        return FALSE; /* not enough data */
+
+      image.offset = pos + 2;
+      if (pos + 2 + n_pixels <= chunk_end)
+        image.pixels = values + (pos + 2 - *offset);
+      else
+        image.pixels = NULL;
+
+      g_array_append_val (images, image);
+
+      pos += n_pixels + 2;
+    }
+
+  *offset = pos;
+
+  return TRUE;
+}
+
+/* Parse the image headers of _NET_WM_ICON. A property that fits in one
+ * chunk takes a single request. Otherwise further chunks are read from
+ * the first header not yet seen; they cannot be requested up front,
+ * since each header's position depends on the size of the image
+ * before it.
+ */
+static gboolean
+read_rgb_icon_headers (MetaDisplay      *display,
+                       xcb_connection_t *xcb_conn,
+                       Window            xwindow,
+                       guint64          *total_length,
+                       GPtrArray        *chunks,
+                       GArray           *images)
+{
+  guint64 offset = 0;
+
+  do
+    {
+      if (!read_rgb_icon_chunk (display, xcb_conn, xwindow,
+                                &offset, total_length, chunks, images))
+        return FALSE;
+    }
+  while (offset < *total_length);
+
+  return TRUE;
+}
+
+static xcb_get_property_cookie_t
+request_icon_image (MetaDisplay      *display,
+                    xcb_connection_t *xcb_conn,
+                    Window            xwindow,
+                    const IconImage  *image)
+{
+  return xcb_get_property (xcb_conn, False, xwindow,
+                           display->atom__NET_WM_ICON, XA_CARDINAL,
+                           image->offset,
+                           (guint32) image->width * image->height);
 }
 
 static cairo_surface_t *
-argbdata_to_surface (gulong *argb_data, int w, int h)
+finish_icon_image (xcb_connection_t          *xcb_conn,
+                   xcb_get_property_cookie_t  cookie,
+                   const IconImage           *image,
+                   guint64                    total_length)
 {
-  cairo_surface_t *surface;
-  int y, x, stride;
-  uint32_t *data;
+  xcb_get_property_reply_t *reply;
+  xcb_generic_error_t *error = NULL;
+  cairo_surface_t *surface = NULL;
+  guint64 n_pixels;
 
-  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, w, h);
-  stride = cairo_image_surface_get_stride (surface) / sizeof (uint32_t);
-  data = (uint32_t *) cairo_image_surface_get_data (surface);
+  if (image->pixels)
+    return argbdata_to_surface (image->pixels, image->width, image->height);
 
-  /* One could speed this up a lot. */
-  for (y = 0; y < h; y++)
+  reply = xcb_get_property_reply (xcb_conn, cookie, &error);
+  if (error)
     {
-      for (x = 0; x < w; x++)
-        {
-          uint32_t *p = &data[y * stride + x];
-          gulong *d = &argb_data[y * w + x];
-          *p = *d;
-        }
+      free (error);
+      return NULL;
     }
 
+  if (reply == NULL)
+    return NULL;
+
+  /* The property may have changed under us; the PropertyNotify
+   * for that will make us read it again.
+   */
+  n_pixels = (guint64) image->width * image->height;
+  if (reply->type == XA_CARDINAL && reply->format == 32 &&
+      (guint64) xcb_get_property_value_length (reply) ==
+      n_pixels * sizeof (uint32_t) &&
+      image->offset + n_pixels + reply->bytes_after / sizeof (uint32_t) ==
+      total_length)
+    surface = argbdata_to_surface (xcb_get_property_value (reply),
+                                   image->width, image->height);
+
+  free (reply);
+
   return surface;
 }
 
@@ -195,63 +410,63 @@ read_rgb_icon (MetaDisplay      *display,
                cairo_surface_t **icon,
                cairo_surface_t **mini_icon)
 {
-  Atom type;
-  int format;
-  gulong nitems;
-  gulong bytes_after;
-  int result, err;
-  guchar *data;
-  gulong *best;
-  int w, h;
-  gulong *best_mini;
-  int mini_w, mini_h;
-  gulong *data_as_long;
-
-  meta_error_trap_push (display);
-  type = None;
-  data = NULL;
-  result = XGetWindowProperty (display->xdisplay,
-			       xwindow,
-                               display->atom__NET_WM_ICON,
-			       0, G_MAXLONG,
-			       False, XA_CARDINAL, &type, &format, &nitems,
-			       &bytes_after, &data);
-  err = meta_error_trap_pop_with_return (display);
+  xcb_connection_t *xcb_conn = XGetXCBConnection (display->xdisplay);
+  xcb_get_property_cookie_t icon_cookie = { 0 }, mini_icon_cookie = { 0 };
+  const IconImage *best;
+  const IconImage *best_mini;
+  guint64 total_length = 0;
+  GPtrArray *chunks;
+  GArray *images;
+  gboolean ret = FALSE;
+
+  /* Only the headers and the two chosen images are transferred, rather
+   * than the whole property, which can hold many megabytes of sizes we
+   * would throw away.
+   */
+  chunks = g_ptr_array_new_with_free_func (free);
+  images = g_array_new (FALSE, FALSE, sizeof (IconImage));
 
-  if (err != Success ||
-      result != Success)
-    return FALSE;
+  if (!read_rgb_icon_headers (display, xcb_conn, xwindow,
+                              &total_length, chunks, images))
+    goto out;
 
-  if (type != XA_CARDINAL)
-    {
-      XFree (data);
-      return FALSE;
-    }
-
-  data_as_long = (gulong *)data;
+  best = find_best_size (images, ideal_width, ideal_height);
+  best_mini = find_best_size (images, ideal_mini_width, ideal_mini_height);
+  if (best == NULL || best_mini == NULL)
+    goto out;
 
-  if (!find_best_size (data_as_long, nitems,
-                       ideal_width, ideal_height,
-                       &w, &h, &best))
-    {
-      XFree (data);
-      return FALSE;
-    }
+  /* Images not already read along with the headers are requested
+   * together, before waiting on either reply.
+   */
+  if (best->pixels == NULL)
+    icon_cookie = request_icon_image (display, xcb_conn, xwindow, best);
+  if (best_mini != best && best_mini->pixels == NULL)
+    mini_icon_cookie = request_icon_image (display, xcb_conn, xwindow, best_mini);
+
+  *icon = finish_icon_image (xcb_conn, icon_cookie, best, total_length);
+
+  if (best_mini != best)
+    *mini_icon = finish_icon_image (xcb_conn, mini_icon_cookie, best_mini,
+                                    total_length);
+  else if (*icon)
+    *mini_icon = cairo_surface_reference (*icon);
+  else
+    *mini_icon = NULL;
 
-  if (!find_best_size (data_as_long, nitems,
-                       ideal_mini_width, ideal_mini_height,
-                       &mini_w, &mini_h, &best_mini))
+  if (*icon == NULL || *mini_icon == NULL)
     {
-      XFree (data);
-      return FALSE;
+      g_clear_pointer (icon, cairo_surface_destroy);
+      g_clear_pointer (mini_icon, cairo_surface_destroy);
+      goto out;
     }
 
-  *icon = argbdata_to_surface (best, w, h);
-  *mini_icon = argbdata_to_surface (best_mini, mini_w, mini_h);
+  ret = TRUE;
 
-  XFree (data);
+ out:
+  g_array_free (images, TRUE);
+  g_ptr_array_free (chunks, TRUE);
 
-  return TRUE;
+  return ret;
 }
 
 static void
@@ -0,0 +1,185 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Accounting of synchronous X requests */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * When MUTTER_DEBUG_ROUNDTRIPS is set in the environment, every call
+ * site wrapped in META_X_ROUNDTRIP() records how often it blocked on the
+ * X server and for how long. A report ranked by total blocking time is
+ * printed to stderr on SIGUSR1 and when mutter exits, so that changes
+ * adding synchronous requests to hot paths show up in test runs.
+ */
+
+#include <config.h>
+
+#include "roundtrip-audit.h"
+
+#include <signal.h>
+#include <string.h>
+#include <glib-unix.h>
+
+typedef struct
+{
+  const char *request;
+  const char *function;
+  guint       count;
+  gint64      total_us;
+  gint64      max_us;
+} RoundtripSite;
+
+static gboolean audit_enabled = FALSE;
+static GHashTable *audit_sites = NULL;
+
+static guint
+site_hash (gconstpointer key)
+{
+  const RoundtripSite *site = key;
+
+  return g_str_hash (site->request) * 31 + g_str_hash (site->function);
+}
+
+static gboolean
+site_equal (gconstpointer a,
+            gconstpointer b)
+{
+  const RoundtripSite *site_a = a;
+  const RoundtripSite *site_b = b;
+
+  return strcmp (site_a->request, site_b->request) == 0 &&
+         strcmp (site_a->function, site_b->function) == 0;
+}
+
+static gint
+compare_sites (gconstpointer a,
+               gconstpointer b)
+{
+  const RoundtripSite *site_a = *(RoundtripSite **) a;
+  const RoundtripSite *site_b = *(RoundtripSite **) b;
+
+  if (site_a->total_us != site_b->total_us)
+    return site_a->total_us > site_b->total_us ? -1 : 1;
+
+  return (gint) site_b->count - (gint) site_a->count;
+}
+
+static gboolean
+on_sigusr1 (gpointer user_data)
+{
+  meta_roundtrip_audit_dump ();
+
+  return G_SOURCE_CONTINUE;
+}
+
+void
+meta_roundtrip_audit_init (void)
+{
+  if (g_getenv ("MUTTER_DEBUG_ROUNDTRIPS") == NULL)
+    return;
+
+  audit_enabled = TRUE;
+  audit_sites = g_hash_table_new_full (site_hash, site_equal, g_free, NULL);
+
+  g_unix_signal_add (SIGUSR1, on_sigusr1, NULL);
+}
+
+gint64
+meta_roundtrip_audit_begin (void)
+{
+  if (!audit_enabled)
+    return 0;
+
+  return g_get_monotonic_time ();
+}
+
+void
+meta_roundtrip_audit_end (gint64      start_time,
+                          const char *request,
+                          const char *function)
+{
+  RoundtripSite key = { request, function };
+  RoundtripSite *site;
+  gint64 elapsed;
+
+  if (!audit_enabled)
+    return;
+
+  elapsed = g_get_monotonic_time () - start_time;
+
+  /* request and function are string literals, so they can be kept
+   * without copying */
+  site = g_hash_table_lookup (audit_sites, &key);
+  if (site == NULL)
+    {
+      site = g_new0 (RoundtripSite, 1);
+      site->request = request;
+      site->function = function;
+      g_hash_table_add (audit_sites, site);
+    }
+
+  site->count++;
+  site->total_us += elapsed;
+  site->max_us = MAX (site->max_us, elapsed);
+}
+
+/**
+ * meta_roundtrip_audit_dump: (skip)
+ *
+ * Prints the recorded X round trips to stderr, heaviest call sites first.
+ * Does nothing unless MUTTER_DEBUG_ROUNDTRIPS is set.
+ */
+void
+meta_roundtrip_audit_dump (void)
+{
+  GPtrArray *sites;
+  GHashTableIter iter;
+  gpointer key;
+  guint total_count = 0;
+  gint64 total_us = 0;
+  guint i;
+
+  if (!audit_enabled)
+    return;
+
+  sites = g_ptr_array_sized_new (g_hash_table_size (audit_sites));
+  g_hash_table_iter_init (&iter, audit_sites);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_ptr_array_add (sites, key);
+
+  g_ptr_array_sort (sites, compare_sites);
+
+  g_printerr ("X round trips by call site:\n");
+  g_printerr ("%8s %12s %10s %10s  %s\n",
+              "count", "total (us)", "avg (us)", "max (us)", "request / caller");
+
+  for (i = 0; i < sites->len; i++)
+    {
+      RoundtripSite *site = g_ptr_array_index (sites, i);
+
+      g_printerr ("%8u %12" G_GINT64_FORMAT " %10" G_GINT64_FORMAT
+                  " %10" G_GINT64_FORMAT "  %s in %s()\n",
+                  site->count, site->total_us, site->total_us / site->count,
+                  site->max_us, site->request, site->function);
+
+      total_count += site->count;
+      total_us += site->total_us;
+    }
+
+  g_printerr ("%8u %12" G_GINT64_FORMAT "  total\n", total_count, total_us);
+
+  g_ptr_array_free (sites, TRUE);
+}
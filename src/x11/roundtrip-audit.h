@@ -0,0 +1,49 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Accounting of synchronous X requests */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef META_ROUNDTRIP_AUDIT_H
+#define META_ROUNDTRIP_AUDIT_H
+
+#include <glib.h>
+
+void     meta_roundtrip_audit_init   (void);
+void     meta_roundtrip_audit_dump   (void);
+
+gint64   meta_roundtrip_audit_begin  (void);
+void     meta_roundtrip_audit_end    (gint64      start_time,
+                                      const char *request,
+                                      const char *function);
+
+/* Wraps a statement that blocks on the X server, e.g.
+ *
+ *   META_X_ROUNDTRIP ("XGetWindowAttributes",
+ *                     ok = XGetWindowAttributes (xdisplay, xwindow, &attrs));
+ *
+ * When auditing is disabled this only costs a flag check.
+ */
+#define META_X_ROUNDTRIP(request, statement)                            \
+  G_STMT_START {                                                        \
+    gint64 _meta_roundtrip_start = meta_roundtrip_audit_begin ();       \
+    statement;                                                          \
+    if (_meta_roundtrip_start != 0)                                     \
+      meta_roundtrip_audit_end (_meta_roundtrip_start,                  \
+                                request, G_STRFUNC);                    \
+  } G_STMT_END
+
+#endif
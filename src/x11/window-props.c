@@ -113,6 +113,156 @@ meta_window_reload_property_from_xwindow (MetaWindow      *window,
   meta_prop_free_values (&value, 1);
 }
 
+typedef struct
+{
+  MetaWindow *window;
+  Window xwindow;
+  Atom property;
+} PendingPropReload;
+
+static gboolean
+flush_property_reloads_later (gpointer data)
+{
+  MetaDisplay *display = data;
+
+  display->pending_prop_reloads_later = 0;
+  meta_display_flush_property_reloads (display);
+
+  return FALSE;
+}
+
+void
+meta_window_queue_property_reload (MetaWindow      *window,
+                                   Window           xwindow,
+                                   Atom             property)
+{
+  MetaDisplay *display = window->display;
+  PendingPropReload reload;
+  MetaWindowPropHooks *hooks;
+  guint i;
+
+  hooks = find_hooks (display, property);
+  if (!hooks || (hooks->flags & INIT_ONLY))
+    return;
+
+  if (display->pending_prop_reloads == NULL)
+    display->pending_prop_reloads = g_array_new (FALSE, FALSE,
+                                                 sizeof (PendingPropReload));
+
+  /* Pending reloads only pile up between two non-PropertyNotify
+   * events, so this stays short.
+   */
+  for (i = 0; i < display->pending_prop_reloads->len; i++)
+    {
+      PendingPropReload *pending = &g_array_index (display->pending_prop_reloads,
+                                                   PendingPropReload, i);
+
+      if (pending->xwindow == xwindow && pending->property == property)
+        {
+          display->n_coalesced_property_notifies++;
+          meta_topic (META_DEBUG_SYNC,
+                      "Coalesced property notify on %s (%u so far)\n",
+                      window->desc, display->n_coalesced_property_notifies);
+          return;
+        }
+    }
+
+  reload.window = window;
+  reload.xwindow = xwindow;
+  reload.property = property;
+  g_array_append_val (display->pending_prop_reloads, reload);
+
+  if (!display->pending_prop_reloads_later)
+    display->pending_prop_reloads_later =
+      meta_later_add (META_LATER_BEFORE_REDRAW,
+                      flush_property_reloads_later,
+                      display, NULL);
+}
+
+void
+meta_window_cancel_property_reloads (MetaWindow *window)
+{
+  GArray *pending_prop_reloads = window->display->pending_prop_reloads;
+  guint i;
+
+  if (pending_prop_reloads == NULL)
+    return;
+
+  i = 0;
+  while (i < pending_prop_reloads->len)
+    {
+      PendingPropReload *pending = &g_array_index (pending_prop_reloads,
+                                                   PendingPropReload, i);
+
+      if (pending->window == window)
+        g_array_remove_index (pending_prop_reloads, i);
+      else
+        i++;
+    }
+}
+
+void
+meta_display_flush_property_reloads (MetaDisplay *display)
+{
+  GArray *pending_prop_reloads = display->pending_prop_reloads;
+
+  if (pending_prop_reloads == NULL)
+    return;
+
+  while (pending_prop_reloads->len > 0)
+    {
+      PendingPropReload first;
+      MetaPropValue *values;
+      MetaWindowPropHooks **hooks;
+      int n_values = 0;
+      guint i;
+
+      /* Take every pending reload for the first X window in the queue
+       * out of it before running any hooks, so that hooks queueing or
+       * cancelling reloads don't disturb this batch.
+       */
+      first = g_array_index (pending_prop_reloads, PendingPropReload, 0);
+      values = g_new0 (MetaPropValue, pending_prop_reloads->len);
+      hooks = g_new0 (MetaWindowPropHooks *, pending_prop_reloads->len);
+
+      i = 0;
+      while (i < pending_prop_reloads->len)
+        {
+          PendingPropReload *pending = &g_array_index (pending_prop_reloads,
+                                                       PendingPropReload, i);
+
+          if (pending->xwindow != first.xwindow)
+            {
+              i++;
+              continue;
+            }
+
+          hooks[n_values] = find_hooks (display, pending->property);
+          init_prop_value (first.window, hooks[n_values], &values[n_values]);
+          n_values++;
+
+          g_array_remove_index (pending_prop_reloads, i);
+        }
+
+      meta_prop_get_values (display, first.xwindow, values, n_values);
+
+      /* A hook may unmanage the window; the rest of the batch is
+       * dropped then, as the events would have found no window.
+       */
+      for (i = 0; i < (guint) n_values; i++)
+        {
+          if (meta_display_lookup_x_window (display, first.xwindow) != first.window)
+            break;
+
+          reload_prop_value (first.window, hooks[i], &values[i], FALSE);
+        }
+
+      meta_prop_free_values (values, n_values);
+      g_free (values);
+      g_free (hooks);
+    }
+}
+
 static void
 meta_window_reload_property (MetaWindow      *window,
                              Atom             property,
@@ -1879,6 +2029,14 @@ meta_display_init_window_prop_hooks (MetaDisplay *display)
 void
 meta_display_free_window_prop_hooks (MetaDisplay *display)
 {
+  if (display->pending_prop_reloads_later)
+    {
+      meta_later_remove (display->pending_prop_reloads_later);
+      display->pending_prop_reloads_later = 0;
+    }
+
+  g_clear_pointer (&display->pending_prop_reloads, g_array_unref);
+
   g_hash_table_unref (display->prop_hooks);
   display->prop_hooks = NULL;
 
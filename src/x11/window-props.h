@@ -49,6 +49,41 @@ void meta_window_reload_property_from_xwindow (MetaWindow      *window,
                                                Atom             property,
                                                gboolean         initial);
 
+/**
+ * meta_window_queue_property_reload:
+ * @window:     The window the property belongs to.
+ * @xwindow:    The X handle for the window.
+ * @property:   A single X atom.
+ *
+ * Like meta_window_reload_property_from_xwindow(), but defers the
+ * reload until meta_display_flush_property_reloads() so that repeated
+ * notifications for the same property only cause one fetch.
+ */
+void meta_window_queue_property_reload (MetaWindow      *window,
+                                        Window           xwindow,
+                                        Atom             property);
+
+/**
+ * meta_window_cancel_property_reloads:
+ * @window:     The window.
+ *
+ * Drops any reloads queued for @window; used when it is unmanaged.
+ */
+void meta_window_cancel_property_reloads (MetaWindow *window);
+
+/**
+ * meta_display_flush_property_reloads:
+ * @display:    The display.
+ *
+ * Fetches all queued properties, one batch per X window, and runs
+ * their reload hooks. Batches are ordered by the first reload queued
+ * for each X window, and all the hooks of a batch run together, in
+ * queueing order, rather than interleaved with other windows' events.
+ * The hooks see the display's current time as of the event that caused
+ * the flush, not the time of their PropertyNotify.
+ */
+void meta_display_flush_property_reloads (MetaDisplay *display);
+
 /**
  * meta_window_load_initial_properties:
  * @window:      The window.
@@ -28,6 +28,7 @@
 #include <string.h>
 #include <X11/Xatom.h>
 #include <X11/Xlibint.h> /* For display->resource_mask */
+#include <X11/Xlib-xcb.h>
 
 #include <X11/extensions/shape.h>
 
@@ -45,6 +46,7 @@
 #include "window-props.h"
 #include "xprops.h"
 #include "session.h"
+#include "roundtrip-audit.h"
 #include "workspace-private.h"
 
 #include "backends/x11/meta-backend-x11.h"
@@ -576,6 +578,8 @@ meta_window_x11_unmanage (MetaWindow *window)
   MetaWindowX11 *window_x11 = META_WINDOW_X11 (window);
   MetaWindowX11Private *priv = meta_window_x11_get_instance_private (window_x11);
 
+  meta_window_cancel_property_reloads (window);
+
   meta_error_trap_push (window->display);
 
   meta_window_x11_destroy_sync_request_alarm (window);
@@ -942,8 +946,7 @@ sync_request_timeout (gpointer data)
       meta_window_update_resize (window,
                                  window->display->grab_last_user_action_was_snap,
                                  window->display->grab_latest_motion_x,
-                                 window->display->grab_latest_motion_y,
-                                 TRUE);
+                                 window->display->grab_latest_motion_y);
     }
 
   return FALSE;
@@ -2147,7 +2150,10 @@ process_property_notify (MetaWindow     *window,
         xid = window->user_time_window;
     }
 
-  meta_window_reload_property_from_xwindow (window, xid, event->atom, FALSE);
+  /* Clients often rewrite the same property several times in a row;
+   * the reload is deferred until the run of PropertyNotify events ends.
+   */
+  meta_window_queue_property_reload (window, xid, event->atom);
 
   return TRUE;
 }
@@ -2851,11 +2857,17 @@ wm_state_to_string (int state)
 }
 #endif
 
-MetaWindow *
-meta_window_x11_new (MetaDisplay       *display,
-                     Window             xwindow,
-                     gboolean           must_be_viewable,
-                     MetaCompEffect     effect)
+/* @prefetched_attrs and @prefetched_wm_state, if not %NULL and -1,
+ * are what XGetWindowAttributes() and reading WM_STATE would have
+ * returned; WithdrawnState stands for a missing WM_STATE.
+ */
+static MetaWindow *
+window_x11_new_internal (MetaDisplay       *display,
+                         Window             xwindow,
+                         gboolean           must_be_viewable,
+                         MetaCompEffect     effect,
+                         XWindowAttributes *prefetched_attrs,
+                         int                prefetched_wm_state)
 {
   MetaScreen *screen = display->screen;
   XWindowAttributes attrs;
@@ -2881,11 +2893,22 @@ meta_window_x11_new (MetaDisplay       *display,
    * so we must be careful with X error handling.
    */
 
-  if (!XGetWindowAttributes (display->xdisplay, xwindow, &attrs))
+  if (prefetched_attrs != NULL)
     {
-      meta_verbose ("Failed to get attributes for window 0x%lx\n",
-                    xwindow);
-      goto error;
+      attrs = *prefetched_attrs;
+    }
+  else
+    {
+      Status status;
+
+      META_X_ROUNDTRIP ("XGetWindowAttributes",
+                        status = XGetWindowAttributes (display->xdisplay, xwindow, &attrs));
+      if (!status)
+        {
+          meta_verbose ("Failed to get attributes for window 0x%lx\n",
+                        xwindow);
+          goto error;
+        }
     }
 
   if (attrs.root != screen->xroot)
@@ -2911,12 +2934,23 @@ meta_window_x11_new (MetaDisplay       *display,
     {
       /* Only manage if WM_STATE is IconicState or NormalState */
       uint32_t state;
+      gboolean have_state;
 
-      /* WM_STATE isn't a cardinal, it's type WM_STATE, but is an int */
-      if (!(meta_prop_get_cardinal_with_atom_type (display, xwindow,
-                                                   display->atom_WM_STATE,
-                                                   display->atom_WM_STATE,
-                                                   &state) &&
+      if (prefetched_wm_state >= 0)
+        {
+          state = prefetched_wm_state;
+          have_state = TRUE;
+        }
+      else
+        {
+          /* WM_STATE isn't a cardinal, it's type WM_STATE, but is an int */
+          have_state = meta_prop_get_cardinal_with_atom_type (display, xwindow,
+                                                              display->atom_WM_STATE,
+                                                              display->atom_WM_STATE,
+                                                              &state);
+        }
+
+      if (!(have_state &&
             (state == IconicState || state == NormalState)))
         {
           meta_verbose ("Deciding not to manage unmapped or unviewable window 0x%lx\n", xwindow);
@@ -3017,6 +3051,192 @@ error:
   return NULL;
 }
 
+MetaWindow *
+meta_window_x11_new (MetaDisplay       *display,
+                     Window             xwindow,
+                     gboolean           must_be_viewable,
+                     MetaCompEffect     effect)
+{
+  return window_x11_new_internal (display, xwindow, must_be_viewable, effect,
+                                  NULL, -1);
+}
+
+static Visual *
+find_visual (Display  *xdisplay,
+             Window    xroot,
+             VisualID  visual_id,
+             Screen  **xscreen_out)
+{
+  int i, j, k;
+
+  for (i = 0; i < ScreenCount (xdisplay); i++)
+    {
+      Screen *xscreen = ScreenOfDisplay (xdisplay, i);
+
+      if (RootWindowOfScreen (xscreen) != xroot)
+        continue;
+
+      *xscreen_out = xscreen;
+
+      for (j = 0; j < xscreen->ndepths; j++)
+        {
+          Depth *depth = &xscreen->depths[j];
+
+          for (k = 0; k < depth->nvisuals; k++)
+            {
+              if (depth->visuals[k].visualid == visual_id)
+                return &depth->visuals[k];
+            }
+        }
+    }
+
+  return NULL;
+}
+
+/* Fill in @attrs the way XGetWindowAttributes() would from the two
+ * requests it makes.
+ */
+static void
+fill_window_attributes (MetaDisplay                       *display,
+                        xcb_get_window_attributes_reply_t *attr_reply,
+                        xcb_get_geometry_reply_t          *geometry_reply,
+                        XWindowAttributes                 *attrs)
+{
+  Screen *xscreen = NULL;
+
+  attrs->x = geometry_reply->x;
+  attrs->y = geometry_reply->y;
+  attrs->width = geometry_reply->width;
+  attrs->height = geometry_reply->height;
+  attrs->border_width = geometry_reply->border_width;
+  attrs->depth = geometry_reply->depth;
+  attrs->root = geometry_reply->root;
+
+  attrs->visual = find_visual (display->xdisplay, geometry_reply->root,
+                               attr_reply->visual, &xscreen);
+  attrs->screen = xscreen;
+  attrs->class = attr_reply->_class;
+  attrs->bit_gravity = attr_reply->bit_gravity;
+  attrs->win_gravity = attr_reply->win_gravity;
+  attrs->backing_store = attr_reply->backing_store;
+  attrs->backing_planes = attr_reply->backing_planes;
+  attrs->backing_pixel = attr_reply->backing_pixel;
+  attrs->save_under = attr_reply->save_under;
+  attrs->colormap = attr_reply->colormap;
+  attrs->map_installed = attr_reply->map_is_installed;
+  attrs->map_state = attr_reply->map_state;
+  attrs->all_event_masks = attr_reply->all_event_masks;
+  attrs->your_event_mask = attr_reply->your_event_mask;
+  attrs->do_not_propagate_mask = attr_reply->do_not_propagate_mask;
+  attrs->override_redirect = attr_reply->override_redirect;
+}
+
+/**
+ * meta_window_x11_manage_existing:
+ * @display: a #MetaDisplay
+ * @xwindows: the top-level windows to adopt, bottom to top
+ * @n_xwindows: the number of windows in @xwindows
+ *
+ * Adopts windows that already exist when we start managing the screen.
+ * Rather than paying a round trip per window for its attributes,
+ * geometry and WM_STATE, all of those requests go out at once and the
+ * replies are collected in order before any window is set up.
+ */
+void
+meta_window_x11_manage_existing (MetaDisplay  *display,
+                                 const Window *xwindows,
+                                 int           n_xwindows)
+{
+  xcb_connection_t *xcb_conn = XGetXCBConnection (display->xdisplay);
+  xcb_get_window_attributes_cookie_t *attr_cookies;
+  xcb_get_geometry_cookie_t *geometry_cookies;
+  xcb_get_property_cookie_t *state_cookies;
+  XWindowAttributes *attrs;
+  gboolean *have_attrs;
+  int *wm_states;
+  int i;
+#ifdef WITH_VERBOSE_MODE
+  gint64 start_time = g_get_monotonic_time ();
+#endif
+
+  attr_cookies = g_new (xcb_get_window_attributes_cookie_t, n_xwindows);
+  geometry_cookies = g_new (xcb_get_geometry_cookie_t, n_xwindows);
+  state_cookies = g_new (xcb_get_property_cookie_t, n_xwindows);
+
+  for (i = 0; i < n_xwindows; i++)
+    {
+      attr_cookies[i] = xcb_get_window_attributes (xcb_conn, xwindows[i]);
+      geometry_cookies[i] = xcb_get_geometry (xcb_conn, xwindows[i]);
+      state_cookies[i] = xcb_get_property (xcb_conn, FALSE, xwindows[i],
+                                           display->atom_WM_STATE,
+                                           display->atom_WM_STATE,
+                                           0, 1);
+    }
+
+  xcb_flush (xcb_conn);
+
+  attrs = g_new0 (XWindowAttributes, n_xwindows);
+  have_attrs = g_new0 (gboolean, n_xwindows);
+  wm_states = g_new (int, n_xwindows);
+
+  for (i = 0; i < n_xwindows; i++)
+    {
+      xcb_get_window_attributes_reply_t *attr_reply;
+      xcb_get_geometry_reply_t *geometry_reply;
+      xcb_get_property_reply_t *state_reply;
+      xcb_generic_error_t *e = NULL;
+
+      attr_reply = xcb_get_window_attributes_reply (xcb_conn, attr_cookies[i], &e);
+      g_clear_pointer (&e, free);
+      geometry_reply = xcb_get_geometry_reply (xcb_conn, geometry_cookies[i], &e);
+      g_clear_pointer (&e, free);
+      state_reply = xcb_get_property_reply (xcb_conn, state_cookies[i], &e);
+      g_clear_pointer (&e, free);
+
+      if (attr_reply && geometry_reply)
+        {
+          fill_window_attributes (display, attr_reply, geometry_reply, &attrs[i]);
+          have_attrs[i] = TRUE;
+        }
+
+      wm_states[i] = WithdrawnState;
+      if (state_reply &&
+          state_reply->type == display->atom_WM_STATE &&
+          state_reply->format == 32 &&
+          xcb_get_property_value_length (state_reply) >= 4)
+        wm_states[i] = *(uint32_t *) xcb_get_property_value (state_reply);
+
+      free (attr_reply);
+      free (geometry_reply);
+      free (state_reply);
+    }
+
+  for (i = 0; i < n_xwindows; i++)
+    {
+      if (!have_attrs[i])
+        {
+          meta_verbose ("Failed to get attributes for window 0x%lx\n",
+                        xwindows[i]);
+          continue;
+        }
+
+      window_x11_new_internal (display, xwindows[i], TRUE,
+                               META_COMP_EFFECT_NONE,
+                               &attrs[i], wm_states[i]);
+    }
+
+  g_free (attr_cookies);
+  g_free (geometry_cookies);
+  g_free (state_cookies);
+  g_free (attrs);
+  g_free (have_attrs);
+  g_free (wm_states);
+
+  meta_topic (META_DEBUG_STARTUP,
+              "Adopted %d existing windows in %" G_GINT64_FORMAT " us\n",
+              n_xwindows, g_get_monotonic_time () - start_time);
+}
+
 void
 meta_window_x11_recalc_window_type (MetaWindow *window)
 {
@@ -3161,7 +3381,7 @@ meta_window_x11_configure_notify (MetaWindow      *window,
    * on its geometry.
    */
   if (window->override_redirect)
-    meta_screen_queue_check_fullscreen (window->screen);
+    meta_screen_queue_check_fullscreen_for_window (window->screen, window);
 
   if (!event->override_redirect && !event->send_event)
     meta_warning ("Unhandled change of windows override redirect status\n");
@@ -3262,7 +3482,7 @@ meta_window_x11_create_sync_request_alarm (MetaWindow *window)
                              window->sync_request_counter,
                              &init))
         {
-          meta_error_trap_pop_with_return (window->display);
+          meta_error_trap_pop (window->display);
           window->sync_request_counter = None;
           return;
         }
@@ -3358,8 +3578,7 @@ meta_window_x11_update_sync_request_counter (MetaWindow *window,
       meta_window_update_resize (window,
                                  window->display->grab_last_user_action_was_snap,
                                  window->display->grab_latest_motion_x,
-                                 window->display->grab_latest_motion_y,
-                                 TRUE);
+                                 window->display->grab_latest_motion_y);
     }
 
   /* If sync was previously disabled, turn it back on and hope
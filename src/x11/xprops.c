@@ -88,6 +88,7 @@ from The Open Group.
 #include "util-private.h"
 #include "ui.h"
 #include "mutter-Xatomtype.h"
+#include "roundtrip-audit.h"
 #include "window-private.h"
 
 #include <X11/Xatom.h>
@@ -906,7 +907,7 @@ meta_prop_get_values (MetaDisplay   *display,
   /* Get replies for all our tasks */
   meta_topic (META_DEBUG_SYNC, "Syncing to get %d GetProperty replies in %s\n",
               n_values, G_STRFUNC);
-  XSync (display->xdisplay, False);
+  META_X_ROUNDTRIP ("XSync", XSync (display->xdisplay, False));
 
   /* Collect results, should arrive in order requested */
   i = 0;